@@ -0,0 +1,65 @@
+/**
+ * @file I2C_Handler.h
+ * This file contains the definition for an I2C master utility object
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+#ifndef ALARM_CLOCK_LAMP_I2C_HANDLER_H
+#define ALARM_CLOCK_LAMP_I2C_HANDLER_H
+
+#include "stm32f1xx.h"
+
+class I2C_Handler {
+public:
+    using callback_t = void (*)(uint32_t arg);
+
+    enum result_t : uint8_t {
+        OK,
+        NACK,
+        BUS_ERROR,
+        ARBITRATION_LOST,
+        TIMEOUT
+    };
+
+    /**
+     * Configures the I2C and DMA peripherals for their usage
+     */
+    virtual void config_periph() = 0;
+
+    /**
+     * Starts a write transaction, the data has to stay valid until it is complete
+     * @param address 7 bit slave address
+     * @param wrdata Array of bytes to write
+     * @param wrdata_length Number of bytes to write
+     * @param blocking Whether the function should busy wait until the transaction is complete
+     */
+    virtual void write_transaction(uint8_t address, const uint8_t *wrdata, uint8_t wrdata_length, bool blocking) = 0;
+
+    /**
+     * Starts a read transaction
+     * @param address 7 bit slave address
+     * @param rxbuffer Array of bytes to read into
+     * @param rxbuffer_length Number of bytes to read
+     * @param blocking Whether the function should busy wait until the transaction is complete
+     */
+    virtual void read_transaction(uint8_t address, uint8_t *rxbuffer, uint8_t rxbuffer_length, bool blocking) = 0;
+
+    /**
+     * Returns whether an I2C transaction is currently ongoing
+     */
+    virtual bool is_busy() = 0;
+
+    /**
+     * Outcome of the last complete transaction
+     */
+    virtual result_t result() = 0;
+
+    /**
+     * Sets the function called from interrupt context once a non blocking transaction is complete
+     * @param callback Function to call, nullptr for none
+     * @param arg Passed to the callback
+     */
+    virtual void set_callback(callback_t callback, uint32_t arg) = 0;
+};
+
+#endif //ALARM_CLOCK_LAMP_I2C_HANDLER_H
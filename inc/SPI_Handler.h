@@ -11,6 +11,8 @@
 
 class SPI_Handler {
 public:
+    using callback_t = void (*)(uint32_t arg);
+
     /**
      * Configures the SPI and DMA peripherals for their usage
      */
@@ -38,6 +40,13 @@ public:
      * Returns the wether a SPI transaction is currently ongoing
      */
     virtual bool is_busy() = 0;
+
+    /**
+     * Sets the function called from interrupt context once a non blocking transaction is complete
+     * @param callback Function to call, nullptr for none
+     * @param arg Passed to the callback
+     */
+    virtual void set_callback(callback_t callback, uint32_t arg) = 0;
 };
 
 #endif //ALARM_CLOCK_LAMP_SPI_HANDLER_H
@@ -0,0 +1,281 @@
+/**
+ * @file STMF1_I2C_Handler.h
+ * An interrupt and DMA driven implementation of the I2C Handler for the STM32F1.\n
+ * Follows the DMA sequences of the reference manual and works around the F1 errata:
+ * - Events that have to be handled before the current byte ends run at DMA priority, single byte reads
+ *   clear ACK and ADDR and set STOP with interrupts disabled
+ * - Reads of 2 or more bytes let the DMA LAST bit generate the NACK, avoiding the BTF based N=2/N=3 methods
+ * - A new START waits for the previous STOP to be released
+ * - A BUSY flag stuck from a glitch or a slave holding SDA is cleared by clocking SCL by hand and a software reset
+ *
+ * A transaction that does not complete within TIMEOUT_MS is aborted and the bus recovered.
+ * Start transactions from thread mode only, the timeout runs on the timer wheel. The wheel is thread mode only,
+ * so a transaction that completes in an interrupt cancels its timeout in the next is_busy(), as AWAIT_I2C polls it.
+ * test/i2c_test.cpp plays the bus events against a model of the registers.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_STMF1_I2C_HANDLER_H
+#define ALARM_CLOCK_LAMP_STMF1_I2C_HANDLER_H
+
+#include "I2C_Handler.h"
+#include "peripherals.h"
+#include "irq.h"
+#include "timers.h"
+
+class STMF1_I2C_Handler : public I2C_Handler {
+public:
+    struct stats_t {
+        uint32_t transfers;
+        uint32_t nacks;
+        uint32_t bus_errors;
+        uint32_t arbitration_lost;
+        uint32_t timeouts;
+        uint32_t recoveries;
+    };
+
+    static constexpr uint32_t TIMEOUT_MS = 5; // 5 bytes at 400kHz take ~125us
+
+private:
+    I2C_TypeDef *I2C{};
+    DMA_Channel_TypeDef *DMA_Ch_TX{}, *DMA_Ch_RX{};
+    GPIO_TypeDef *GPIO{};
+    uint8_t pin_scl{}, pin_sda{};
+    callback_t callback{};
+    uint32_t callback_arg{};
+    volatile bool in_flight{};
+    volatile result_t last_result{};
+    uint8_t address_byte{};
+    uint8_t *single_byte{}; // Target of a one byte read, which runs without DMA
+    timers::timer_t timeout_timer{};
+    stats_t statistics{};
+
+    uint8_t flag_shift(DMA_Channel_TypeDef *DMA_Ch) {
+        return static_cast<uint8_t>(4 * (((uint32_t) DMA_Ch - (uint32_t) DMA1_Channel1) / 20));
+    }
+
+    void finish(result_t result) {
+        DMA_Ch_TX->CCR &= ~(DMA_CCR_EN | DMA_CCR_TCIE);
+        DMA_Ch_RX->CCR &= ~(DMA_CCR_EN | DMA_CCR_TCIE);
+        DMA1->IFCR = DMA_IFCR_CGIF1 << flag_shift(DMA_Ch_TX) | DMA_IFCR_CGIF1 << flag_shift(DMA_Ch_RX);
+        I2C->CR2 &= ~(I2C_CR2_DMAEN | I2C_CR2_LAST | I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN);
+        last_result = result;
+        statistics.transfers++;
+        in_flight = false;
+        if (!irq::in_handler()) {
+            timers::cancel(timeout_timer);
+        }
+        if (callback) {
+            callback(callback_arg);
+        }
+    }
+
+    /**
+     * Frees a bus held by a slave and clears a stuck BUSY flag
+     */
+    void recover() {
+        uint32_t cr2 = I2C->CR2, ccr = I2C->CCR, trise = I2C->TRISE;
+        I2C->CR1 &= ~I2C_CR1_PE;
+        gpio::set(GPIO, pin_scl);
+        gpio::set(GPIO, pin_sda);
+        gpio::config(GPIO, pin_scl, gpio::OUT_OD, gpio::SPEED_50MHZ);
+        gpio::config(GPIO, pin_sda, gpio::OUT_OD, gpio::SPEED_50MHZ);
+        for (uint8_t i = 0; i < 9 && !(GPIO->IDR & (1 << pin_sda)); i++) {
+            gpio::reset(GPIO, pin_scl);
+            dwt::delay_us(5);
+            gpio::set(GPIO, pin_scl);
+            dwt::delay_us(5);
+        }
+        gpio::reset(GPIO, pin_sda); // STOP condition
+        dwt::delay_us(5);
+        gpio::set(GPIO, pin_sda);
+        dwt::delay_us(5);
+        gpio::config(GPIO, pin_scl, gpio::AF_OD, gpio::SPEED_50MHZ);
+        gpio::config(GPIO, pin_sda, gpio::AF_OD, gpio::SPEED_50MHZ);
+        I2C->CR1 = I2C_CR1_SWRST;
+        I2C->CR1 = 0;
+        I2C->CR2 = cr2 & I2C_CR2_FREQ;
+        I2C->CCR = ccr;
+        I2C->TRISE = trise;
+        I2C->CR1 = I2C_CR1_PE;
+        statistics.recoveries++;
+    }
+
+    /**
+     * Reading SR2 after SR1 clears ADDR
+     */
+    void clear_addr() {
+        uint32_t sr2 = I2C->SR2;
+        (void) sr2;
+    }
+
+    static void timeout(uint32_t arg) {
+        reinterpret_cast<STMF1_I2C_Handler *>(arg)->abort();
+    }
+
+    void begin(uint8_t address, uint8_t *data, uint8_t length, bool read, bool blocking) {
+        while (in_flight);
+        dwt::deadline_t stop_released = dwt::deadline_us(100);
+        while ((I2C->CR1 & I2C_CR1_STOP) && !dwt::expired(stop_released));
+        if ((I2C->CR1 & I2C_CR1_STOP) || (I2C->SR2 & I2C_SR2_BUSY)) {
+            recover();
+        }
+        address_byte = static_cast<uint8_t>(address << 1 | read);
+        DMA_Channel_TypeDef *DMA_Ch = read ? DMA_Ch_RX : DMA_Ch_TX;
+        uint32_t cr2 = I2C_CR2_ITEVTEN | I2C_CR2_ITERREN;
+        single_byte = nullptr;
+        if (read && length == 1) {
+            single_byte = data; // RXNE interrupt instead of DMA
+        } else {
+            DMA_Ch->CMAR = (uint32_t) data;
+            DMA_Ch->CNDTR = length;
+            DMA_Ch->CCR |= (read ? DMA_CCR_TCIE : 0) | DMA_CCR_EN;
+            cr2 |= I2C_CR2_DMAEN | (read ? I2C_CR2_LAST : 0);
+        }
+        MODIFY_REG(I2C->CR2, I2C_CR2_DMAEN | I2C_CR2_LAST | I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN, cr2);
+        if (read) {
+            I2C->CR1 |= I2C_CR1_ACK;
+        }
+        in_flight = true;
+        if (!blocking) {
+            timers::start(timeout_timer, TIMEOUT_MS, timeout, (uint32_t) this);
+        }
+        I2C->CR1 |= I2C_CR1_START;
+        if (blocking) {
+            dwt::deadline_t deadline = dwt::deadline_us(TIMEOUT_MS * 1000);
+            while (in_flight && !dwt::expired(deadline));
+            abort();
+        }
+    }
+
+public:
+
+    STMF1_I2C_Handler() = default;
+
+    void set_periphs(I2C_TypeDef *I2C_, DMA_Channel_TypeDef *DMA_TX, DMA_Channel_TypeDef *DMA_RX,
+                     GPIO_TypeDef *GPIO_, uint8_t scl, uint8_t sda) {
+        I2C = I2C_; DMA_Ch_TX = DMA_TX; DMA_Ch_RX = DMA_RX;
+        GPIO = GPIO_; pin_scl = scl; pin_sda = sda;
+    }
+
+    void config_periph() override {
+        DMA_Ch_TX->CCR = DMA_CCR_MINC | DMA_CCR_DIR;
+        DMA_Ch_TX->CPAR = (uint32_t) &I2C->DR;
+        DMA_Ch_RX->CCR = DMA_CCR_MINC;
+        DMA_Ch_RX->CPAR = (uint32_t) &I2C->DR;
+        dwt::enable_cyccnt();
+    }
+
+    void write_transaction(uint8_t address, const uint8_t *wrdata, uint8_t wrdata_length, bool blocking) override {
+        begin(address, const_cast<uint8_t *>(wrdata), wrdata_length, false, blocking);
+    }
+
+    void read_transaction(uint8_t address, uint8_t *rxbuffer, uint8_t rxbuffer_length, bool blocking) override {
+        begin(address, rxbuffer, rxbuffer_length, true, blocking);
+    }
+
+    bool is_busy() override {
+        if (!in_flight) {
+            timers::cancel(timeout_timer); // Completed in an interrupt, which must not touch the wheel
+        }
+        return in_flight;
+    }
+
+    result_t result() override {
+        return last_result;
+    }
+
+    void set_callback(callback_t callback_, uint32_t arg) override {
+        callback = callback_;
+        callback_arg = arg;
+    }
+
+    const stats_t &stats() {
+        return statistics;
+    }
+
+    /**
+     * Ends a hanging transaction with TIMEOUT, does nothing if none is in flight
+     */
+    void abort() {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq(); // Races the completion interrupts
+        bool hanging = in_flight;
+        if (hanging) {
+            I2C->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN);
+            DMA_Ch_RX->CCR &= ~DMA_CCR_TCIE;
+            in_flight = false;
+        }
+        __set_PRIMASK(primask);
+        if (hanging) {
+            statistics.timeouts++;
+            recover();
+            finish(TIMEOUT);
+        }
+    }
+
+    /**
+     * Call from the I2C event interrupt
+     */
+    void irq_event() {
+        uint32_t sr1 = I2C->SR1;
+        if (sr1 & I2C_SR1_SB) {
+            I2C->DR = address_byte;
+        } else if (sr1 & I2C_SR1_ADDR) {
+            if (single_byte) {
+                __disable_irq(); // ACK, ADDR and STOP must happen before the byte completes
+                I2C->CR1 &= ~I2C_CR1_ACK;
+                clear_addr();
+                I2C->CR1 |= I2C_CR1_STOP;
+                __enable_irq();
+                I2C->CR2 |= I2C_CR2_ITBUFEN;
+            } else {
+                clear_addr(); // The DMA takes over
+            }
+        } else if ((sr1 & I2C_SR1_RXNE) && single_byte) {
+            *single_byte = static_cast<uint8_t>(I2C->DR);
+            finish(OK);
+        } else if ((sr1 & I2C_SR1_BTF) && !(address_byte & 1) && !DMA_Ch_TX->CNDTR) {
+            I2C->CR1 |= I2C_CR1_STOP; // Last byte is out of the shift register
+            finish(OK);
+        }
+    }
+
+    /**
+     * Call from the I2C error interrupt
+     */
+    void irq_error() {
+        uint32_t sr1 = I2C->SR1;
+        I2C->SR1 = ~(I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR);
+        if (!in_flight) {
+            return;
+        }
+        if (sr1 & I2C_SR1_AF) {
+            I2C->CR1 |= I2C_CR1_STOP;
+            statistics.nacks++;
+            finish(NACK);
+        } else if (sr1 & I2C_SR1_ARLO) {
+            statistics.arbitration_lost++; // The peripheral already released the bus
+            finish(ARBITRATION_LOST);
+        } else if (sr1 & (I2C_SR1_BERR | I2C_SR1_OVR)) {
+            I2C->CR1 |= I2C_CR1_STOP;
+            statistics.bus_errors++;
+            finish(BUS_ERROR);
+        }
+    }
+
+    /**
+     * Finishes a read, call from the RX DMA channel interrupt. Writes finish on BTF in irq_event
+     */
+    void irq_dma_rx() {
+        DMA1->IFCR = DMA_IFCR_CGIF1 << flag_shift(DMA_Ch_RX);
+        if (!in_flight) {
+            return;
+        }
+        I2C->CR1 |= I2C_CR1_STOP; // The NACK was sent with the last byte thanks to LAST
+        finish(OK);
+    }
+};
+
+#endif //ALARM_CLOCK_LAMP_STMF1_I2C_HANDLER_H
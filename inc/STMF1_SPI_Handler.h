@@ -18,6 +18,17 @@ private:
     DMA_Channel_TypeDef *DMA_Ch_TX{}, *DMA_Ch_RX{};
     GPIO_TypeDef *GPIO_CS{};
     uint8_t pin_cs{};
+    callback_t callback{};
+    uint32_t callback_arg{};
+    volatile bool in_flight{};
+    uint8_t rx_dummy{};
+
+    /**
+     * Shift of the channels flags in the DMA ISR/IFCR registers
+     */
+    uint8_t flag_shift(DMA_Channel_TypeDef *DMA_Ch) {
+        return static_cast<uint8_t>(4 * (((uint32_t) DMA_Ch - (uint32_t) DMA1_Channel1) / 20));
+    }
 
 public:
 
@@ -36,12 +47,23 @@ public:
         DMA_Ch_RX->CPAR = (uint32_t) &SPI->DR;
     }
 
+    /**
+     * Non blocking writes clock the received bytes into a dummy byte, so the RX channel signals completion
+     */
     void write_transaction(const uint8_t *wrdata, uint8_t wrdata_length, bool blocking) override {
+        while (in_flight);
         gpio::set(GPIO_CS, pin_cs);
         DMA_Ch_TX->CCR &= ~DMA_CCR_EN;
-        DMA_Ch_RX->CCR &= ~DMA_CCR_EN;
+        DMA_Ch_RX->CCR &= ~(DMA_CCR_EN | DMA_CCR_MINC | DMA_CCR_TCIE);
         DMA_Ch_TX->CMAR = (uint32_t) wrdata;
         DMA_Ch_TX->CNDTR = wrdata_length;
+        if (!blocking) {
+            (void) SPI->DR;
+            DMA_Ch_RX->CMAR = (uint32_t) &rx_dummy;
+            DMA_Ch_RX->CNDTR = wrdata_length;
+            DMA_Ch_RX->CCR |= DMA_CCR_TCIE | DMA_CCR_EN;
+            in_flight = true;
+        }
         gpio::reset(GPIO_CS, pin_cs);
         DMA_Ch_TX->CCR |= DMA_CCR_EN;
         if (blocking) {
@@ -52,24 +74,49 @@ public:
     }
 
     void read_transaction(const uint8_t *wrdata, uint8_t wrdata_length, const uint8_t *rxbuffer, uint8_t rxbuffer_length, bool blocking) override {
+        while (in_flight);
         gpio::set(GPIO_CS, pin_cs);
         DMA_Ch_TX->CCR &= ~DMA_CCR_EN;
-        DMA_Ch_RX->CCR &= ~DMA_CCR_EN;
+        DMA_Ch_RX->CCR &= ~(DMA_CCR_EN | DMA_CCR_TCIE);
+        DMA_Ch_RX->CCR |= DMA_CCR_MINC;
         DMA_Ch_TX->CMAR = (uint32_t) wrdata;
         DMA_Ch_TX->CNDTR = wrdata_length;
         DMA_Ch_RX->CMAR = (uint32_t) rxbuffer;
         DMA_Ch_RX->CNDTR = rxbuffer_length;
+        if (!blocking) {
+            DMA_Ch_RX->CCR |= DMA_CCR_TCIE;
+            in_flight = true;
+        }
         gpio::reset(GPIO_CS, pin_cs);
         DMA_Ch_TX->CCR |= DMA_CCR_EN;
         DMA_Ch_RX->CCR |= DMA_CCR_EN;
-        if (blocking || DMA_Ch_RX->CNDTR) {
-            while(is_busy());
+        if (blocking) {
+            while(is_busy() || DMA_Ch_RX->CNDTR);
             gpio::set(GPIO_CS, pin_cs);
         }
     }
 
     bool is_busy() override {
-        return (SPI->SR & SPI_SR_BSY);
+        return in_flight || (SPI->SR & SPI_SR_BSY);
+    }
+
+    void set_callback(callback_t callback_, uint32_t arg) override {
+        callback = callback_;
+        callback_arg = arg;
+    }
+
+    /**
+     * Finishes a non blocking transaction, call from the RX DMA channel interrupt
+     */
+    void irq() {
+        DMA1->IFCR = DMA_IFCR_CGIF1 << flag_shift(DMA_Ch_RX);
+        while (SPI->SR & SPI_SR_BSY);
+        gpio::set(GPIO_CS, pin_cs);
+        DMA_Ch_RX->CCR &= ~(DMA_CCR_EN | DMA_CCR_TCIE);
+        in_flight = false;
+        if (callback) {
+            callback(callback_arg);
+        }
     }
 };
 
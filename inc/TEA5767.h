@@ -0,0 +1,146 @@
+/**
+ * @file TEA5767.h
+ * A wrapper class for the TEA5767 FM tuner on I2C, BUSMODE tied to GND.\n
+ * The five control bytes are kept in the object and written as a whole, the five status bytes are read as a whole.
+ * 32.768kHz crystal, PLL reference 32768Hz, Europe band 87.5-108MHz
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_TEA5767_H
+#define ALARM_CLOCK_LAMP_TEA5767_H
+
+#include "I2C_Handler.h"
+
+class TEA5767 {
+    I2C_Handler *i2c_handler;
+    uint8_t control[5]; // Must outlive non blocking writes
+    uint8_t status[5];
+public:
+    static constexpr uint8_t ADDRESS = 0x60;
+    static constexpr uint16_t IF_KHZ = 225;
+    static constexpr uint32_t BAND_LOW_KHZ = 87500;
+    static constexpr uint32_t BAND_HIGH_KHZ = 108000;
+    static constexpr uint8_t IF_COUNT_MIN = 0x31; // Valid IF counter range of a tuned station
+    static constexpr uint8_t IF_COUNT_MAX = 0x3e;
+
+    enum control_bits_t : uint8_t {
+        // Byte 0
+        MUTE = 0x80,
+        SEARCH_MODE = 0x40,
+        // Byte 2
+        HLSI = 0x10, // High side injection
+        MONO = 0x08,
+        // Byte 3
+        STANDBY = 0x40,
+        XTAL = 0x10, // 32.768kHz crystal
+        SOFT_MUTE = 0x08,
+        HIGH_CUT = 0x04,
+        STEREO_NOISE_CANCEL = 0x02,
+        // Byte 4
+        DTC = 0x40 // 75us de-emphasis, 0 = 50us for Europe
+    };
+
+    void set_i2c_handler(I2C_Handler *handler) {
+        i2c_handler = handler;
+        control[0] = MUTE;
+        control[1] = 0;
+        control[2] = HLSI;
+        control[3] = XTAL | SOFT_MUTE | STEREO_NOISE_CANCEL;
+        control[4] = 0;
+    }
+
+    I2C_Handler &handler() {
+        return *i2c_handler;
+    }
+
+    /**
+     * PLL word for a frequency, N = 4 * (f_RF +- f_IF) / f_ref with f_ref = 32768Hz, rounded, no division
+     * @param khz Target frequency in kHz
+     * @param high_side Injection side, the LO is above the RF for high side
+     */
+    static uint16_t pll_word(uint32_t khz, bool high_side) {
+        uint32_t lo_khz = high_side ? khz + IF_KHZ : khz - IF_KHZ;
+        return static_cast<uint16_t>((4000 * lo_khz + (1 << 14)) >> 15);
+    }
+
+    /**
+     * Sets the frequency and injection side of the next write
+     */
+    void set_frequency(uint32_t khz, bool high_side) {
+        uint16_t pll = pll_word(khz, high_side);
+        control[0] = static_cast<uint8_t>((control[0] & (MUTE | SEARCH_MODE)) | (pll >> 8 & 0x3f));
+        control[1] = static_cast<uint8_t>(pll);
+        control[2] = static_cast<uint8_t>(high_side ? control[2] | HLSI : control[2] & ~HLSI);
+    }
+
+    void set_mute(bool mute) {
+        control[0] = static_cast<uint8_t>(mute ? control[0] | MUTE : control[0] & ~MUTE);
+    }
+
+    void set_standby(bool standby) {
+        control[3] = static_cast<uint8_t>(standby ? control[3] | STANDBY : control[3] & ~STANDBY);
+    }
+
+    bool high_side() {
+        return control[2] & HLSI;
+    }
+
+    /**
+     * Writes the control bytes, non blocking completion is signaled by the I2C handlers callback
+     */
+    void write(bool blocking=false) {
+        i2c_handler->write_transaction(ADDRESS, control, 5, blocking);
+    }
+
+    /**
+     * Reads the status bytes, non blocking completion is signaled by the I2C handlers callback
+     */
+    void read(bool blocking=false) {
+        i2c_handler->read_transaction(ADDRESS, status, 5, blocking);
+    }
+
+    /**
+     * Station found or band limit reached in search mode, PLL settled otherwise
+     */
+    bool ready() {
+        return status[0] & 0x80;
+    }
+
+    bool band_limit() {
+        return status[0] & 0x40;
+    }
+
+    bool stereo() {
+        return status[2] & 0x80;
+    }
+
+    /**
+     * IF counter, within IF_COUNT_MIN..IF_COUNT_MAX when really tuned to a station
+     */
+    uint8_t if_count() {
+        return status[2] & 0x7f;
+    }
+
+    bool if_valid() {
+        return if_count() >= IF_COUNT_MIN && if_count() <= IF_COUNT_MAX;
+    }
+
+    /**
+     * ADC level, 0..15
+     */
+    uint8_t level() {
+        return status[3] >> 4;
+    }
+
+    /**
+     * Frequency from the PLL word of the last read
+     */
+    uint32_t frequency_khz() {
+        uint32_t pll = static_cast<uint32_t>(status[0] & 0x3f) << 8 | status[1];
+        uint32_t lo_khz = (pll * 8192 + 500) / 1000;
+        return high_side() ? lo_khz - IF_KHZ : lo_khz + IF_KHZ;
+    }
+};
+
+#endif //ALARM_CLOCK_LAMP_TEA5767_H
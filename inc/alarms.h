@@ -0,0 +1,317 @@
+/**
+ * @file alarms.h
+ * Alarm table with recurring, one shot and holiday aware alarms, driving the RTC alarm.\n
+ * Every enabled alarm keeps its precomputed next fire time in an indexed min-heap, so the next alarm is the heap top
+ * and arming the RTC takes O(1). An edit recomputes only the edited alarm and moves it in the heap, O(log n).
+ * The next fire time itself needs no day by day search: the weekday mask is rotated to the start day and CTZ
+ * finds the next matching day, holidays can only push it on MAX_HOLIDAYS times.
+ * Only a holiday edit or setting the clock recomputes all alarms, which is still bounded by MAX_ALARMS.
+ *
+ * Skip next is resolved when the alarm comes due: the occurrence is dropped and the flag cleared.
+ * A one shot alarm rings at the next matching day and disables itself.
+ * The table lives in storage page 7 and is rewritten on every change. The erase stalls every flash fetch, interrupts
+ * included, for ~20ms, so a due alarm is saved before its callback starts light or sound.
+ * test/alarms_test.cpp checks the heap top against a brute force scan over randomized edits.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_ALARMS_H
+#define ALARM_CLOCK_LAMP_ALARMS_H
+
+#include "peripherals.h"
+#include "rtc.h"
+
+namespace alarms {
+    constexpr uint8_t MAX_ALARMS = 16;
+    constexpr uint8_t MAX_HOLIDAYS = 16;
+    constexpr uint32_t NEVER = 0xffffffff;
+
+    enum flags_t : uint8_t {
+        ENABLED = 1,
+        ONE_SHOT = 2,
+        SKIP_NEXT = 4,
+        HOLIDAYS_OFF = 8 // Does not ring on holidays
+    };
+
+    struct alarm_t {
+        uint16_t minute; // Minute of the day
+        uint8_t weekdays; // Bit 0 = Monday, 0 = any day
+        uint8_t flags;
+        uint8_t action; // Passed to the fire callback, interpreted by the application
+        uint8_t arg;
+        uint16_t reserved;
+    };
+
+    struct table_t {
+        uint16_t magic;
+        uint8_t holiday_count;
+        uint8_t reserved;
+        alarm_t alarms[MAX_ALARMS];
+        uint16_t holidays[MAX_HOLIDAYS]; // Days since 2000-01-01
+    };
+
+    using callback_t = void (*)(uint8_t slot, const alarm_t &alarm);
+
+    /**
+     * Alarm table in storage page 7
+     */
+    namespace store {
+        constexpr uint32_t BASE = flash::STORAGE + 7 * flash::PAGE_SIZE;
+        constexpr uint16_t MAGIC = 0x414c;
+
+        bool load(table_t &table) {
+            const table_t &stored = *reinterpret_cast<const table_t *>(BASE);
+            if (stored.magic != MAGIC || stored.holiday_count > MAX_HOLIDAYS) {
+                return false;
+            }
+            table = stored;
+            return true;
+        }
+
+        bool save(table_t &table) {
+            table.magic = MAGIC;
+            return flash::erase_page(BASE) && flash::program(BASE, reinterpret_cast<const uint8_t *>(&table), sizeof(table));
+        }
+    }
+
+    table_t table;
+    uint32_t next_fire[MAX_ALARMS];
+    uint8_t heap[MAX_ALARMS]; // Slots ordered by next_fire
+    uint8_t position[MAX_ALARMS]; // Index in heap, NOT_QUEUED if disabled
+    uint8_t heap_size;
+    callback_t fire_callback;
+
+    constexpr uint8_t NOT_QUEUED = 0xff;
+
+    bool is_holiday(uint32_t day) {
+        for (uint8_t i = 0; i < table.holiday_count; i++) {
+            if (table.holidays[i] == day) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * First fire time of the alarm after the given time, NEVER if it cannot ring
+     */
+    uint32_t next_after(const alarm_t &alarm, uint32_t after) {
+        if (!(alarm.flags & ENABLED) || alarm.minute >= 24 * 60) {
+            return NEVER;
+        }
+        uint32_t day = after / 86400;
+        uint32_t at = alarm.minute * 60UL;
+        if (at <= after - day * 86400) {
+            day++;
+        }
+        uint32_t mask = alarm.weekdays & 0x7f ? alarm.weekdays & 0x7f : 0x7f;
+        for (uint8_t i = 0; i <= MAX_HOLIDAYS; i++) {
+            uint32_t weekday = (day + rtc::EPOCH_WEEKDAY) % 7;
+            uint32_t rotated = (mask >> weekday | mask << (7 - weekday)) & 0x7f; // Bit k: weekday + k days
+            day += __builtin_ctz(rotated);
+            if (!(alarm.flags & HOLIDAYS_OFF) || !is_holiday(day)) {
+                return day * 86400 + at;
+            }
+            day++;
+        }
+        return NEVER;
+    }
+
+    bool earlier(uint8_t a, uint8_t b) {
+        return next_fire[heap[a]] < next_fire[heap[b]];
+    }
+
+    void swap(uint8_t a, uint8_t b) {
+        uint8_t slot = heap[a];
+        heap[a] = heap[b];
+        heap[b] = slot;
+        position[heap[a]] = a;
+        position[heap[b]] = b;
+    }
+
+    void sift_up(uint8_t i) {
+        while (i && earlier(i, static_cast<uint8_t>((i - 1) / 2))) {
+            swap(i, static_cast<uint8_t>((i - 1) / 2));
+            i = static_cast<uint8_t>((i - 1) / 2);
+        }
+    }
+
+    void sift_down(uint8_t i) {
+        while (true) {
+            uint8_t smallest = i;
+            uint8_t left = static_cast<uint8_t>(2 * i + 1), right = static_cast<uint8_t>(2 * i + 2);
+            if (left < heap_size && earlier(left, smallest)) smallest = left;
+            if (right < heap_size && earlier(right, smallest)) smallest = right;
+            if (smallest == i) {
+                return;
+            }
+            swap(i, smallest);
+            i = smallest;
+        }
+    }
+
+    /**
+     * Moves a slot to its place for the new fire time, adds or removes it as needed
+     */
+    void update(uint8_t slot, uint32_t fire) {
+        next_fire[slot] = fire;
+        uint8_t i = position[slot];
+        if (fire == NEVER) {
+            if (i != NOT_QUEUED) {
+                uint8_t last = --heap_size;
+                if (i != last) {
+                    swap(i, last); // The last one fills the gap
+                    uint8_t moved = heap[i];
+                    sift_up(i);
+                    sift_down(position[moved]);
+                }
+                position[slot] = NOT_QUEUED;
+            }
+            return;
+        }
+        if (i == NOT_QUEUED) {
+            i = heap_size++;
+            heap[i] = slot;
+            position[slot] = i;
+        }
+        sift_up(i);
+        sift_down(position[slot]);
+    }
+
+    /**
+     * Next fire time of all alarms, NEVER if none is enabled
+     */
+    uint32_t next() {
+        return heap_size ? next_fire[heap[0]] : NEVER;
+    }
+
+    void arm() {
+        if (heap_size) {
+            rtc::set_alarm(next());
+        } else {
+            rtc::cancel_alarm();
+        }
+    }
+
+    /**
+     * RTC alarm callback, handles every alarm that came due
+     */
+    void on_alarm() {
+        uint32_t now = rtc::now();
+        bool changed = false;
+        uint8_t due[MAX_ALARMS]; // Each slot once, its next fire time is after now
+        uint8_t due_count = 0;
+        while (heap_size && next_fire[heap[0]] <= now) {
+            uint8_t slot = heap[0];
+            alarm_t &alarm = table.alarms[slot];
+            if (alarm.flags & SKIP_NEXT) {
+                alarm.flags &= ~SKIP_NEXT;
+                changed = true;
+            } else {
+                if (alarm.flags & ONE_SHOT) {
+                    alarm.flags &= ~ENABLED;
+                    changed = true;
+                }
+                due[due_count++] = slot;
+            }
+            update(slot, next_after(alarm, now));
+        }
+        if (changed) {
+            store::save(table);
+        }
+        arm();
+        for (uint8_t i = 0; i < due_count && fire_callback; i++) {
+            fire_callback(due[i], table.alarms[due[i]]);
+        }
+    }
+
+    /**
+     * Recomputes every alarm, after the clock was set or the holidays changed
+     */
+    void rebuild() {
+        uint32_t now = rtc::now();
+        heap_size = 0;
+        for (uint8_t slot = 0; slot < MAX_ALARMS; slot++) {
+            position[slot] = NOT_QUEUED;
+        }
+        for (uint8_t slot = 0; slot < MAX_ALARMS; slot++) {
+            update(slot, next_after(table.alarms[slot], now));
+        }
+        arm();
+    }
+
+    bool set(uint8_t slot, const alarm_t &alarm) {
+        if (slot >= MAX_ALARMS || alarm.minute >= 24 * 60) {
+            return false;
+        }
+        table.alarms[slot] = alarm;
+        update(slot, next_after(alarm, rtc::now()));
+        arm();
+        return store::save(table);
+    }
+
+    bool skip_next(uint8_t slot, bool skip) {
+        if (slot >= MAX_ALARMS) {
+            return false;
+        }
+        alarm_t &alarm = table.alarms[slot];
+        alarm.flags = static_cast<uint8_t>(skip ? alarm.flags | SKIP_NEXT : alarm.flags & ~SKIP_NEXT);
+        return store::save(table);
+    }
+
+    /**
+     * Drops holidays that are over, they would only block the table
+     */
+    void expire_holidays() {
+        uint32_t today = rtc::now() / 86400;
+        for (uint8_t i = 0; i < table.holiday_count;) {
+            if (table.holidays[i] < today) {
+                table.holidays[i] = table.holidays[--table.holiday_count];
+            } else {
+                i++;
+            }
+        }
+    }
+
+    bool add_holiday(uint16_t day) {
+        if (is_holiday(day)) {
+            return true;
+        }
+        if (table.holiday_count >= MAX_HOLIDAYS) {
+            expire_holidays();
+        }
+        if (table.holiday_count >= MAX_HOLIDAYS) {
+            return false;
+        }
+        table.holidays[table.holiday_count++] = day;
+        rebuild();
+        return store::save(table);
+    }
+
+    bool remove_holiday(uint16_t day) {
+        for (uint8_t i = 0; i < table.holiday_count; i++) {
+            if (table.holidays[i] == day) {
+                table.holidays[i] = table.holidays[--table.holiday_count];
+                rebuild();
+                return store::save(table);
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Call after rtc::init()
+     */
+    void init(callback_t callback) {
+        fire_callback = callback;
+        if (!store::load(table)) {
+            table = {};
+        }
+        expire_holidays();
+        rtc::alarm_callback = on_alarm;
+        rebuild();
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_ALARMS_H
@@ -0,0 +1,205 @@
+/**
+ * @file async.h
+ * Stackless resumable tasks for driver sequences, in the style of protothreads.\n
+ * A task body is a function that is reentered at its last AWAIT each time the task is resumed.
+ * Locals do not survive an AWAIT, keep state in the task or in statics.
+ * Delays of whole milliseconds run on the timer wheel, shorter ones on the short compare of the timebase,
+ * only pulses of a few microseconds busy wait.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_ASYNC_H
+#define ALARM_CLOCK_LAMP_ASYNC_H
+
+#include "events.h"
+#include "timers.h"
+#include "SPI_Handler.h"
+
+namespace async {
+    struct task_t;
+
+    /**
+     * Returns true once the task has run to its end
+     */
+    using body_t = bool (*)(task_t &task);
+
+    struct task_t {
+        body_t body;
+        uint16_t line; // Resume point, 0 = start
+        uint8_t id;
+        timers::timer_t timer; // Used by the delay awaits
+        uint32_t wake_us; // Microsecond delay, while waiting_us
+        bool waiting_us;
+    };
+
+    constexpr uint8_t MAX_TASKS = 8;
+    constexpr uint32_t US_EXPIRED = MAX_TASKS; // Resume id of the short compare
+    constexpr uint32_t SPIN_MAX_US = 20; // Below the cost of a wakeup through the event loop
+    task_t *tasks[MAX_TASKS];
+
+    void short_expired() {
+        events::post(events::ASYNC_RESUME, US_EXPIRED);
+    }
+
+    /**
+     * Points the short compare at the earliest microsecond delay
+     */
+    void arm_us() {
+        task_t *earliest = nullptr;
+        uint32_t now = timebase::now_us32();
+        for (task_t *t : tasks) {
+            if (t && t->waiting_us && (!earliest || static_cast<int32_t>(t->wake_us - earliest->wake_us) < 0)) {
+                earliest = t;
+            }
+        }
+        if (!earliest) {
+            timebase::cancel_short_compare();
+        } else if (static_cast<int32_t>(earliest->wake_us - now) <= 0) {
+            short_expired();
+        } else {
+            timebase::set_short_compare(earliest->wake_us, short_expired);
+        }
+    }
+
+    void resume(uint32_t id);
+
+    /**
+     * Resumes every task whose microsecond delay is over
+     */
+    void resume_us() {
+        uint32_t now = timebase::now_us32();
+        for (uint8_t i = 0; i < MAX_TASKS; i++) {
+            task_t *t = tasks[i];
+            if (t && t->waiting_us && static_cast<int32_t>(now - t->wake_us) >= 0) {
+                t->waiting_us = false;
+                resume(i);
+            }
+        }
+        arm_us();
+    }
+
+    /**
+     * Runs a task until its next AWAIT, subscribed to events::ASYNC_RESUME
+     * @param id Index into the task table
+     */
+    void resume(uint32_t id) {
+        if (id == US_EXPIRED) {
+            resume_us();
+            return;
+        }
+        if (id >= MAX_TASKS || !tasks[id]) {
+            return;
+        }
+        task_t &task = *tasks[id];
+        if (task.body(task)) {
+            timers::cancel(task.timer);
+            task.waiting_us = false;
+            tasks[id] = nullptr;
+        }
+    }
+
+    /**
+     * Schedules a resume from any context, usable as SPI or DMA completion callback
+     */
+    void wake(uint32_t id) {
+        events::post(events::ASYNC_RESUME, id);
+    }
+
+    /**
+     * Starts a task, its first step runs from the event loop
+     * @return false if the task table is full or the task is already running
+     */
+    bool start(task_t &task, body_t body) {
+        uint8_t free = MAX_TASKS;
+        for (uint8_t i = 0; i < MAX_TASKS; i++) {
+            if (tasks[i] == &task) {
+                return false;
+            }
+            if (!tasks[i] && free == MAX_TASKS) {
+                free = i;
+            }
+        }
+        if (free == MAX_TASKS) {
+            return false;
+        }
+        task.body = body;
+        task.line = 0;
+        task.waiting_us = false;
+        task.id = free;
+        tasks[free] = &task;
+        wake(free);
+        return true;
+    }
+
+    /**
+     * Continues a running task with another body from its start, return false from the current body afterwards
+     */
+    void chain(task_t &task, body_t body) {
+        task.body = body;
+        task.line = 0;
+        wake(task.id);
+    }
+
+    bool running(const task_t &task) {
+        return task.id < MAX_TASKS && tasks[task.id] == &task;
+    }
+
+    void sleep_ms(task_t &task, uint32_t ms) {
+        timers::start(task.timer, ms, resume, task.id);
+    }
+
+    /**
+     * Sleeps at least the given time. Waits shorter than a wheel tick run on the short compare instead of being
+     * rounded up to a whole millisecond, only waits up to SPIN_MAX_US busy wait on the cycle counter
+     */
+    void sleep_us(task_t &task, uint32_t us) {
+        if (us <= SPIN_MAX_US) {
+            dwt::delay_us(us);
+        } else if (us < 1000) {
+            task.wake_us = timebase::now_us32() + us + 1; // The read may lag the counter by up to 1us
+            task.waiting_us = true;
+            arm_us();
+        } else {
+            sleep_ms(task, (us + 999) / 1000);
+        }
+    }
+
+    bool sleeping(const task_t &task) {
+        return task.waiting_us || timers::active(task.timer);
+    }
+
+    void init() {
+        dwt::enable_cyccnt();
+        events::subscribe(events::ASYNC_RESUME, resume);
+    }
+}
+
+#define ASYNC_BEGIN(task) switch ((task).line) { case 0:
+
+#define ASYNC_END(task) } (task).line = 0; return true
+
+/**
+ * Suspends the task until condition is true, it is reevaluated every time the task is resumed.\n
+ * Only one AWAIT per source line, the line number is the resume point
+ */
+#define AWAIT(task, condition) do { (task).line = __LINE__; [[fallthrough]]; case __LINE__: if (!(condition)) return false; } while (false)
+
+#define AWAIT_DELAY_MS(task, ms) do { async::sleep_ms(task, ms); AWAIT(task, !timers::active((task).timer)); } while (false)
+
+#define AWAIT_DELAY_US(task, us) do { async::sleep_us(task, us); AWAIT(task, !async::sleeping(task)); } while (false)
+
+/**
+ * Starts a non blocking transaction and suspends until it is complete
+ * @param spi SPI_Handler the transaction runs on
+ * @param transaction Statement starting the non blocking transaction
+ */
+#define AWAIT_SPI(task, spi, transaction) do { (spi).set_callback(async::wake, (task).id); transaction; \
+    AWAIT(task, !(spi).is_busy()); } while (false)
+
+/**
+ * Same for an I2C_Handler, check its result() afterwards
+ */
+#define AWAIT_I2C(task, i2c, transaction) AWAIT_SPI(task, i2c, transaction)
+
+#endif //ALARM_CLOCK_LAMP_ASYNC_H
@@ -0,0 +1,398 @@
+/**
+ * @file audio.h
+ * Sample playback of IMA-ADPCM clips on the buzzer pin A15.\n
+ * Clips are 8kHz mono, 4 bit IMA-ADPCM, low nibble first, starting from predictor 0 and step index 0.
+ * TIM2_CH1 runs a 32kHz PWM carrier (10.1 bit), each sample is linearly interpolated to 4 periods,
+ * which also pushes the 8kHz images down. The TIM2_CH4 request (CCR4 = 0, right after the update, as in pwm.h)
+ * moves one duty per period from the ring into CCR1 over DMA1 channel 7.
+ * A ring half holds one decode block of BLOCK samples (4ms), decoded in the DMA interrupt.
+ * The refill runs at RADIO level: it is much longer than an I2C byte time, the 4ms half gives plenty of slack.
+ *
+ * The DMA keeps STOP mode away by itself (see power::dma_active). TIM2 and A15 are shared with buzzer.h,
+ * play() takes them over and stop() hands them back.
+ * Built in clips are synthesized and encoded at compile time, a recorded clip can be uploaded to the storage pages.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_AUDIO_H
+#define ALARM_CLOCK_LAMP_AUDIO_H
+
+#include "peripherals.h"
+#include "buzzer.h"
+
+namespace audio {
+    TIM_TypeDef *const TIM = TIM2;
+    DMA_Channel_TypeDef *const DMA_CH = DMA1_Channel7; // TIM2_CH4 request
+    constexpr uint32_t SAMPLE_RATE = 8000;
+    constexpr uint8_t OVERSAMPLING = 4;
+    constexpr uint16_t PERIOD = static_cast<uint16_t>(36000000 / (SAMPLE_RATE * OVERSAMPLING)); // 1125
+    constexpr uint16_t MID = PERIOD / 2; // Silence
+    constexpr uint16_t BLOCK = 32; // Samples per ring half
+    constexpr uint16_t HALF = BLOCK * OVERSAMPLING;
+    static_assert(HALF == 128, "The ramps shift by 7");
+
+    constexpr int16_t step_table[89] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+        107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+        876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+        5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+        27086, 29794, 32767
+    };
+    constexpr int8_t index_table[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+    /**
+     * IMA-ADPCM predictor, shared by the compile time encoder and the decoder
+     */
+    struct adpcm_t {
+        int32_t predictor;
+        uint8_t index;
+
+        /**
+         * Applies a code and returns the new sample
+         */
+        constexpr int16_t apply(uint8_t code) {
+            int32_t step = step_table[index];
+            int32_t diff = step >> 3;
+            if (code & 4) diff += step;
+            if (code & 2) diff += step >> 1;
+            if (code & 1) diff += step >> 2;
+            predictor += code & 8 ? -diff : diff;
+            if (predictor > 32767) predictor = 32767;
+            if (predictor < -32768) predictor = -32768;
+            int32_t next = index + index_table[code & 7];
+            index = static_cast<uint8_t>(next < 0 ? 0 : next > 88 ? 88 : next);
+            return static_cast<int16_t>(predictor);
+        }
+
+        constexpr uint8_t encode(int32_t sample) {
+            int32_t step = step_table[index];
+            int32_t diff = sample - predictor;
+            uint8_t code = 0;
+            if (diff < 0) {
+                code = 8;
+                diff = -diff;
+            }
+            if (diff >= step) { code |= 4; diff -= step; }
+            step >>= 1;
+            if (diff >= step) { code |= 2; diff -= step; }
+            step >>= 1;
+            if (diff >= step) { code |= 1; }
+            apply(code);
+            return code;
+        }
+    };
+
+    struct clip_t {
+        const uint8_t *data;
+        uint16_t samples;
+    };
+
+    /**
+     * Compile time synthesizer and encoder for the built in clips
+     */
+    namespace synth {
+        constexpr double PI = 3.14159265358979;
+
+        constexpr double cos(double x) {
+            double term = 1, sum = 1;
+            for (uint8_t n = 1; n < 16; n++) {
+                term *= -x * x / ((2 * n - 1) * (2 * n));
+                sum += term;
+            }
+            return sum;
+        }
+
+        constexpr double decay(double seconds) { // Per sample factor for a -60dB decay time, e^(-6.9/n)
+            double x = -6.9 / (seconds * SAMPLE_RATE), term = 1, sum = 1;
+            for (uint8_t n = 1; n < 8; n++) {
+                term *= x / n;
+                sum += term;
+            }
+            return sum;
+        }
+
+        /**
+         * Damped resonator, y[n] = 2r cos(w) y[n-1] - r^2 y[n-2], struck by its first two samples
+         */
+        struct partial_t {
+            double a1{}, a2{}, y1{}, y2{};
+
+            constexpr partial_t() = default;
+
+            constexpr partial_t(double frequency, double amplitude, double seconds)
+                : a1(2 * decay(seconds) * cos(2 * PI * frequency / SAMPLE_RATE)), a2(decay(seconds) * decay(seconds)),
+                  y1(0), y2(0) {
+                y1 = amplitude * decay(seconds) * cos(PI / 2 - 2 * PI * frequency / SAMPLE_RATE); // sin(w)
+            }
+
+            constexpr double next() {
+                double y = y1;
+                double y0 = a1 * y1 - a2 * y2;
+                y2 = y1;
+                y1 = y0;
+                return y;
+            }
+        };
+
+        struct strike_t {
+            double frequency;
+            uint16_t start; // Sample index
+        };
+
+        /**
+         * Bell strikes of a fundamental, a short lived upper partial and the longer hum tone an octave below
+         */
+        template<uint16_t SAMPLES, uint8_t N>
+        struct encoded_t {
+            uint8_t data[SAMPLES / 2];
+
+            constexpr encoded_t(const strike_t (&strikes)[N]) : data{} {
+                partial_t partials[N * 3] = {};
+                for (uint8_t s = 0; s < N; s++) {
+                    partials[3 * s] = partial_t(strikes[s].frequency, 11000, 0.9);
+                    partials[3 * s + 1] = partial_t(strikes[s].frequency * 2.4, 5000, 0.35);
+                    partials[3 * s + 2] = partial_t(strikes[s].frequency * 0.5, 4000, 1.2);
+                }
+                adpcm_t state{};
+                for (uint16_t i = 0; i < SAMPLES; i++) {
+                    double y = 0;
+                    for (uint8_t s = 0; s < N; s++) {
+                        if (i >= strikes[s].start) {
+                            y += partials[3 * s].next() + partials[3 * s + 1].next() + partials[3 * s + 2].next();
+                        }
+                    }
+                    uint8_t code = state.encode(static_cast<int32_t>(y));
+                    data[i / 2] = static_cast<uint8_t>(data[i / 2] | code << (i & 1 ? 4 : 0));
+                }
+            }
+
+            constexpr clip_t clip() const {
+                return {data, SAMPLES};
+            }
+        };
+
+        constexpr strike_t ding_dong[] = {{659.26, 0}, {523.25, 2400}};
+        constexpr strike_t single[] = {{880.0, 0}};
+    }
+
+    constexpr synth::encoded_t<5600, 2> ding_dong(synth::ding_dong); // 0.7s, 2.8K
+    constexpr synth::encoded_t<2400, 1> ding(synth::single);
+
+    constexpr clip_t builtins[] = {ding_dong.clip(), ding.clip()};
+    constexpr uint8_t BUILTIN_COUNT = sizeof(builtins) / sizeof(builtins[0]);
+
+    /**
+     * One uploaded clip in storage pages 5-6 after the u16 sample count, which is programmed last
+     */
+    namespace store {
+        constexpr uint32_t BASE = flash::STORAGE + 5 * flash::PAGE_SIZE;
+        constexpr uint8_t PAGES = 2; // 0.5s
+        constexpr uint16_t CAPACITY = PAGES * flash::PAGE_SIZE - 2;
+
+        clip_t get() {
+            const uint8_t *page = reinterpret_cast<const uint8_t *>(BASE);
+            uint16_t samples = static_cast<uint16_t>(page[0] | page[1] << 8);
+            return {page + 2, samples > 2 * CAPACITY ? static_cast<uint16_t>(0) : samples};
+        }
+
+        bool erase() {
+            for (uint8_t i = 0; i < PAGES; i++) {
+                if (!flash::erase_page(BASE + i * flash::PAGE_SIZE)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * @param offset Even byte offset into the ADPCM data
+         */
+        bool write(uint16_t offset, const uint8_t *data, uint8_t length) {
+            if ((offset & 1) || offset + length > CAPACITY) {
+                return false;
+            }
+            return flash::program(BASE + 2 + offset, data, length);
+        }
+
+        bool commit(uint16_t samples) {
+            if (samples > 2 * CAPACITY) {
+                return false;
+            }
+            uint8_t header[2] = {static_cast<uint8_t>(samples), static_cast<uint8_t>(samples >> 8)};
+            return flash::program(BASE, header, 2);
+        }
+    }
+
+    /**
+     * Clip ids are the built in clips first, then the uploaded one
+     */
+    clip_t get(uint8_t id) {
+        if (id < BUILTIN_COUNT) {
+            return builtins[id];
+        }
+        if (id == BUILTIN_COUNT) {
+            return store::get();
+        }
+        return {nullptr, 0};
+    }
+
+    /**
+     * Decode cycles per ring half refill, late counts refills that found both halves done
+     */
+    struct stats_t {
+        uint32_t blocks;
+        uint32_t cycles_last;
+        uint32_t cycles_max;
+        uint32_t late;
+    };
+
+    enum stage_t : uint8_t {
+        IDLE,
+        RAMP_IN, // From 0 to the mid level, avoids a click
+        PLAY,
+        RAMP_OUT,
+        DONE, // The ramp out is being played
+        SILENT // Stops at the next half
+    };
+
+    uint16_t ring[2 * HALF];
+    volatile stage_t stage;
+    adpcm_t decoder;
+    const uint8_t *cursor;
+    uint16_t position, remaining;
+    int32_t gain; // Volume times the half period, 16.16 per sample unit
+    int32_t previous; // Last duty, start of the interpolation
+    stats_t stats;
+
+    void fill(uint16_t *out) {
+        switch (stage) {
+            case RAMP_IN:
+                for (uint16_t i = 0; i < HALF; i++) {
+                    out[i] = static_cast<uint16_t>(MID * (i + 1U) >> 7);
+                }
+                previous = MID;
+                stage = PLAY;
+                break;
+            case PLAY: {
+                uint16_t count = remaining < BLOCK ? remaining : BLOCK;
+                for (uint16_t i = 0; i < BLOCK; i++) {
+                    int32_t duty = MID;
+                    if (i < count) {
+                        uint8_t byte = cursor[position >> 1];
+                        uint8_t code = static_cast<uint8_t>(position & 1 ? byte >> 4 : byte & 0xf);
+                        position++;
+                        duty += decoder.apply(code) * gain >> 16;
+                    }
+                    int32_t delta = duty - previous;
+                    for (uint8_t k = 1; k <= OVERSAMPLING; k++) {
+                        *out++ = static_cast<uint16_t>(previous + (delta * k >> 2));
+                    }
+                    previous = duty;
+                }
+                remaining = static_cast<uint16_t>(remaining - count);
+                if (!remaining) {
+                    stage = RAMP_OUT;
+                }
+                break;
+            }
+            case RAMP_OUT:
+                for (uint16_t i = 0; i < HALF; i++) {
+                    out[i] = static_cast<uint16_t>(previous * (HALF - 1 - i) >> 7);
+                }
+                stage = DONE;
+                break;
+            default:
+                for (uint16_t i = 0; i < HALF; i++) {
+                    out[i] = 0;
+                }
+                stage = SILENT;
+                break;
+        }
+    }
+
+    /**
+     * Stops playback and hands TIM2 back to the buzzer
+     */
+    void stop() {
+        if (stage == IDLE) {
+            return; // TIM2 may belong to buzzer.h or speaker.h
+        }
+        TIM->DIER &= ~TIM_DIER_CC4DE;
+        DMA_CH->CCR &= ~DMA_CCR_EN;
+        stage = IDLE;
+        TIM->CCR1 = 0;
+        tim::disable(TIM);
+        tim::set_prescaler(TIM, buzzer::PRESCALER);
+        tim::generate_update(TIM);
+    }
+
+    void init() {
+        TIM->CCR4 = 0; // Frozen, only used as DMA request at the start of each period
+        DMA_CH->CPAR = (uint32_t) &TIM->CCR1;
+        DMA_CH->CMAR = (uint32_t) ring;
+        DMA_CH->CCR = DMA_CCR_MSIZE_0 | DMA_CCR_PSIZE_0 | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_DIR
+                    | DMA_CCR_HTIE | DMA_CCR_TCIE;
+        dwt::enable_cyccnt();
+    }
+
+    /**
+     * Plays a clip once, stops the buzzer
+     * @param volume 255 is full scale
+     */
+    bool play(uint8_t id, uint8_t volume) {
+        clip_t clip = get(id);
+        if (!clip.samples) {
+            return false;
+        }
+        buzzer::stop();
+        stop();
+        cursor = clip.data;
+        position = 0;
+        remaining = clip.samples;
+        decoder = {};
+        gain = static_cast<int32_t>(volume * (MID - 1U) >> 7); // Full scale +-32768 maps to +-MID
+        stage = RAMP_IN;
+        fill(ring);
+        fill(ring + HALF);
+        tim::set_prescaler(TIM, 0);
+        tim::set_period(TIM, static_cast<uint16_t>(PERIOD - 1));
+        TIM->CCR1 = 0;
+        tim::generate_update(TIM);
+        DMA1->IFCR = DMA_IFCR_CGIF7;
+        DMA_CH->CNDTR = 2 * HALF;
+        DMA_CH->CCR |= DMA_CCR_EN;
+        TIM->DIER |= TIM_DIER_CC4DE;
+        tim::enable(TIM);
+        return true;
+    }
+
+    bool playing() {
+        return stage != IDLE;
+    }
+
+    /**
+     * Call from DMA1_Channel7_IRQHandler, decodes into the half the DMA just left
+     */
+    void irq() {
+        uint32_t isr = DMA1->ISR;
+        DMA1->IFCR = DMA_IFCR_CGIF7;
+        if (stage == IDLE) {
+            return;
+        }
+        if (stage == SILENT) {
+            stop(); // The ramp out is over
+            return;
+        }
+        uint32_t start = DWT->CYCCNT;
+        if ((isr & DMA_ISR_HTIF7) && (isr & DMA_ISR_TCIF7)) {
+            stats.late++;
+        }
+        fill(isr & DMA_ISR_TCIF7 ? ring + HALF : ring);
+        stats.cycles_last = DWT->CYCCNT - start;
+        if (stats.cycles_last > stats.cycles_max) stats.cycles_max = stats.cycles_last;
+        stats.blocks++;
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_AUDIO_H
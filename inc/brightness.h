@@ -0,0 +1,164 @@
+/**
+ * @file brightness.h
+ * Perceptual brightness pipeline for the LED PWM.\n
+ * Levels are CIE L* scaled to 0..65535, mapped to duty through a table generated at compile time.
+ * The duty keeps 8 fractional bits which a first order sigma-delta spreads over consecutive PWM periods,
+ * giving up to 8 more bits at the low end without a faster PWM. The fraction is rounded to the dither bits of
+ * the PWM mode, so the pattern stays short enough not to flicker: 19 bits at 549Hz, 18 to 19 in the HF modes.
+ * test/brightness_test.cpp checks the curve and every pattern.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_BRIGHTNESS_H
+#define ALARM_CLOCK_LAMP_BRIGHTNESS_H
+
+#include "pwm.h"
+#include "irq.h"
+
+namespace brightness {
+    constexpr uint16_t TABLE_SIZE = 257; // 256 segments, linear interpolation in between
+
+    struct table_t {
+        uint32_t duty_q8[TABLE_SIZE]; // 16.8 fixed point duty
+    };
+
+    /**
+     * CIE 1931 lightness to relative luminance, only evaluated by the compiler
+     */
+    constexpr double lstar_to_luminance(double lstar) {
+        if (lstar <= 8.0) {
+            return lstar / 903.3;
+        }
+        double t = (lstar + 16.0) / 116.0;
+        return t * t * t;
+    }
+
+    constexpr table_t make_table() {
+        table_t table{};
+        for (uint16_t i = 0; i < TABLE_SIZE; i++) {
+            double luminance = lstar_to_luminance(100.0 * i / (TABLE_SIZE - 1));
+            table.duty_q8[i] = static_cast<uint32_t>(luminance * pwm::DUTY_MAX * 256.0 + 0.5);
+        }
+        return table;
+    }
+
+    constexpr table_t table = make_table();
+    static_assert(table.duty_q8[0] == 0 && table.duty_q8[TABLE_SIZE - 1] == pwm::DUTY_MAX * 256UL);
+
+    /**
+     * Maps a perceptual level to a 16.8 fixed point duty
+     */
+    uint32_t to_duty_q8(uint16_t level) {
+        uint8_t index = static_cast<uint8_t>(level >> 8);
+        uint32_t frac = level & 0xff;
+        uint32_t low = table.duty_q8[index];
+        return low + ((table.duty_q8[index + 1] - low) * frac >> 8);
+    }
+
+    /**
+     * Inverse of to_duty_q8, the level a duty is lit at. Binary search of the table, only for starting fades
+     */
+    uint16_t to_level(uint32_t duty_q8) {
+        if (duty_q8 >= table.duty_q8[TABLE_SIZE - 1]) {
+            return 0xffff;
+        }
+        uint16_t low = 0, high = TABLE_SIZE - 1; // table[low] <= duty < table[high]
+        while (high - low > 1) {
+            uint16_t middle = static_cast<uint16_t>((low + high) / 2);
+            if (table.duty_q8[middle] <= duty_q8) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        uint32_t frac = ((duty_q8 - table.duty_q8[low]) << 8) / (table.duty_q8[high] - table.duty_q8[low]);
+        return static_cast<uint16_t>(low << 8 | frac);
+    }
+
+    /**
+     * First order sigma-delta, the fractional duty error is carried into the next PWM period.
+     * Scales to the period of the PWM mode first, so the bits a short period loses end up in the fraction
+     */
+    struct dither_t {
+        uint8_t error;
+
+        uint16_t next(uint32_t duty_q8) {
+            duty_q8 = static_cast<uint32_t>(static_cast<uint64_t>(duty_q8) * pwm::mode->duty_scale_q16 >> 16);
+            uint8_t shift = static_cast<uint8_t>(8 - pwm::mode->dither_bits);
+            duty_q8 = (duty_q8 + (1U << shift >> 1)) >> shift << shift; // Coarser fraction, shorter pattern
+            uint32_t sum = error + (duty_q8 & 0xff);
+            error = static_cast<uint8_t>(sum);
+            uint32_t duty = (duty_q8 >> 8) + (sum >> 8);
+            return duty > pwm::mode->period ? pwm::mode->period : static_cast<uint16_t>(duty);
+        }
+    };
+
+    uint32_t warm, cold; // Current levels in 16.16
+    uint32_t warm_step, cold_step;
+    uint16_t warm_target, cold_target;
+    uint32_t remaining;
+    dither_t warm_dither, cold_dither;
+
+    /**
+     * PWM stream source, advances the fade and dithers each frame
+     */
+    void fill(pwm::frame_t *frames, uint16_t count) {
+        uint32_t warm_q8 = 0, cold_q8 = 0;
+        for (uint16_t i = 0; i < count; i++) {
+            if (remaining) {
+                remaining--;
+                warm += warm_step;
+                cold += cold_step;
+                if (!remaining) {
+                    warm = static_cast<uint32_t>(warm_target) << 16;
+                    cold = static_cast<uint32_t>(cold_target) << 16;
+                }
+            }
+            warm_q8 = to_duty_q8(static_cast<uint16_t>(warm >> 16));
+            cold_q8 = to_duty_q8(static_cast<uint16_t>(cold >> 16));
+            frames[i].warm = warm_dither.next(warm_q8);
+            frames[i].cold = cold_dither.next(cold_q8);
+        }
+        pwm::output = {warm_q8, cold_q8};
+    }
+
+    /**
+     * Fades both channels to the target levels, linear in perceived brightness.
+     * Starts from pwm::output when another engine drove the LEDs
+     */
+    void fade(uint16_t to_warm, uint16_t to_cold, uint32_t duration_ms) {
+        uint32_t frames = pwm::frames_in(duration_ms);
+        irq::critical_section cs; // fill() runs in the DMA interrupt
+        if (pwm::source != fill) {
+            warm = static_cast<uint32_t>(to_level(pwm::output.warm_q8)) << 16;
+            cold = static_cast<uint32_t>(to_level(pwm::output.cold_q8)) << 16;
+        }
+        uint16_t from_warm = static_cast<uint16_t>(warm >> 16);
+        uint16_t from_cold = static_cast<uint16_t>(cold >> 16);
+        warm_step = pwm::ramp::step(from_warm, to_warm, frames);
+        cold_step = pwm::ramp::step(from_cold, to_cold, frames);
+        warm_target = to_warm;
+        cold_target = to_cold;
+        remaining = frames;
+        if (pwm::source != fill) {
+            pwm::stream(fill);
+        }
+    }
+
+    /**
+     * Sets both levels, off turns the stream off entirely so STOP mode is possible again
+     */
+    void set(uint16_t to_warm, uint16_t to_cold) {
+        if (!to_warm && !to_cold) {
+            irq::critical_section cs;
+            remaining = 0;
+            warm = cold = 0;
+            pwm::set(0, 0);
+            return;
+        }
+        fade(to_warm, to_cold, 0);
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_BRIGHTNESS_H
@@ -0,0 +1,196 @@
+/**
+ * @file buttons.h
+ * Debouncing and gestures of the On/Off (A11) and All-off (A12) buttons.\n
+ * The first falling edge wakes the MCU over EXTI, masks both lines and starts sampling on the timer wheel.
+ * Each button has an integrator that needs INTEGRATOR_MAX agreeing samples to change state,
+ * so bounces never reach the gesture logic and cost the same as a clean signal: one sample per tick.
+ * Sampling stops and the EXTI lines are unmasked again once both buttons are idle.
+ *
+ * Gestures are posted as events::BUTTON_GESTURE with the button in the low and the gesture in the high byte:
+ * - SHORT: released before LONG_MS, and no second press within DOUBLE_MS if the button has double presses
+ * - DOUBLE: second press within DOUBLE_MS, reported on that press
+ * - LONG: held for LONG_MS, followed by a REPEAT every REPEAT_MS while still held
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_BUTTONS_H
+#define ALARM_CLOCK_LAMP_BUTTONS_H
+
+#include "peripherals.h"
+#include "events.h"
+#include "timers.h"
+
+namespace buttons {
+    enum button_t : uint8_t {
+        ON_OFF,
+        ALL_OFF,
+        BUTTON_COUNT
+    };
+
+    enum gesture_t : uint8_t {
+        SHORT,
+        DOUBLE,
+        LONG,
+        REPEAT
+    };
+
+    constexpr uint32_t TICK_MS = 5;
+    constexpr uint8_t INTEGRATOR_MAX = 4; // 20ms of a stable level
+    constexpr uint16_t LONG_MS = 600;
+    constexpr uint16_t REPEAT_MS = 200;
+    constexpr uint16_t DOUBLE_MS = 300;
+
+    struct config_t {
+        uint8_t pin;
+        bool double_press; // Without it SHORT is reported right on the release
+    };
+
+    constexpr config_t configs[BUTTON_COUNT] = {
+        {11, true},
+        {12, false}, // All-off must not wait for a second press
+    };
+
+    constexpr uint32_t EXTI_LINES = 1 << 11 | 1 << 12;
+
+    enum phase_t : uint8_t {
+        IDLE,
+        PRESSED,
+        HELD, // LONG reported, repeating
+        WAIT_DOUBLE,
+        SECOND_PRESS // DOUBLE reported, waits for the release
+    };
+
+    struct state_t {
+        uint8_t integrator;
+        bool pressed; // Debounced
+        phase_t phase;
+        uint16_t ticks;
+    };
+
+    state_t states[BUTTON_COUNT];
+    timers::timer_t timer;
+
+    void emit(uint8_t button, gesture_t gesture) {
+        events::post(events::BUTTON_GESTURE, button | gesture << 8);
+    }
+
+    /**
+     * Integrator debounce, the pins are active low
+     */
+    void sample(state_t &s, uint8_t pin) {
+        if (!(GPIOA->IDR & (1 << pin))) {
+            if (s.integrator < INTEGRATOR_MAX) s.integrator++;
+        } else {
+            if (s.integrator) s.integrator--;
+        }
+        if (s.integrator == INTEGRATOR_MAX) {
+            s.pressed = true;
+        } else if (s.integrator == 0) {
+            s.pressed = false;
+        }
+    }
+
+    void step(state_t &s, uint8_t button) {
+        s.ticks++;
+        switch (s.phase) {
+            case IDLE:
+                if (s.pressed) {
+                    s.phase = PRESSED;
+                    s.ticks = 0;
+                }
+                break;
+            case PRESSED:
+                if (!s.pressed) {
+                    if (configs[button].double_press) {
+                        s.phase = WAIT_DOUBLE;
+                        s.ticks = 0;
+                    } else {
+                        emit(button, SHORT);
+                        s.phase = IDLE;
+                    }
+                } else if (s.ticks >= LONG_MS / TICK_MS) {
+                    emit(button, LONG);
+                    s.phase = HELD;
+                    s.ticks = 0;
+                }
+                break;
+            case HELD:
+                if (!s.pressed) {
+                    s.phase = IDLE;
+                } else if (s.ticks >= REPEAT_MS / TICK_MS) {
+                    emit(button, REPEAT);
+                    s.ticks = 0;
+                }
+                break;
+            case WAIT_DOUBLE:
+                if (s.pressed) {
+                    emit(button, DOUBLE);
+                    s.phase = SECOND_PRESS;
+                } else if (s.ticks >= DOUBLE_MS / TICK_MS) {
+                    emit(button, SHORT);
+                    s.phase = IDLE;
+                }
+                break;
+            case SECOND_PRESS:
+                if (!s.pressed) {
+                    s.phase = IDLE;
+                }
+                break;
+        }
+    }
+
+    /**
+     * Unmasks the EXTI lines, an edge between the last sample and now is caught by checking the pins afterwards
+     */
+    bool rearm() {
+        EXTI->PR = EXTI_LINES;
+        EXTI->IMR |= EXTI_LINES;
+        if ((GPIOA->IDR & EXTI_LINES) != EXTI_LINES) {
+            EXTI->IMR &= ~EXTI_LINES;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Timer callback, samples and advances both buttons
+     */
+    void tick(uint32_t) {
+        bool busy = false;
+        for (uint8_t i = 0; i < BUTTON_COUNT; i++) {
+            sample(states[i], configs[i].pin);
+            step(states[i], i);
+            busy |= states[i].phase != IDLE || states[i].integrator;
+        }
+        if (!busy && rearm()) {
+            timers::cancel(timer);
+        }
+    }
+
+    /**
+     * Posted by irq(), starts sampling
+     */
+    void on_edge(uint32_t) {
+        if (!timers::active(timer)) {
+            timers::start(timer, TICK_MS, tick, 0, TICK_MS);
+        }
+    }
+
+    /**
+     * EXTI handler of both lines, only the first edge of a gesture gets here
+     */
+    void irq() {
+        EXTI->IMR &= ~EXTI_LINES;
+        EXTI->PR = EXTI_LINES;
+        events::post(events::BUTTON_EDGE);
+    }
+
+    void init() {
+        events::subscribe(events::BUTTON_EDGE, on_edge);
+        EXTI->IMR &= ~EXTI_LINES;
+        on_edge(0); // Sampling first, it unmasks the lines once both buttons are idle
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_BUTTONS_H
@@ -0,0 +1,198 @@
+/**
+ * @file buzzer.h
+ * Tone and melody generator for the buzzer on A15.\n
+ * The tone is the PWM of TIM2_CH1 (partial remap 1 puts it on A15, JTAG has to be disabled for that),
+ * ARR sets the pitch and CCR1 the duty, which sets the volume: 50% is the loudest, narrower pulses are quieter.
+ * The tone costs no CPU per cycle. Notes and the envelope step every FRAME_MS from the timer wheel,
+ * a preloaded ARR/CCR1 update takes effect at the end of a tone period, so steps never cut a pulse short.
+ * Notes are not stepped by DMA: every TIM2 request (UP, CC1 to CC4) fires at a fixed point of the tone period,
+ * so a DMA stream of ARR/CCR1 would need one entry per tone period, thousands per note instead of a frame every
+ * FRAME_MS. Of the TIM2 requests, UP on channel 2 and CH1 on channel 5 collide with SPI1 RX and I2C2 RX,
+ * CH3 on channel 1 drives speaker.h and CH2/CH4 on channel 7 drives audio.h.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_BUZZER_H
+#define ALARM_CLOCK_LAMP_BUZZER_H
+
+#include "peripherals.h"
+#include "power.h"
+#include "timers.h"
+
+namespace buzzer {
+    TIM_TypeDef *const TIM = TIM2;
+    constexpr uint16_t PRESCALER = 7; // The lowest note C3 still fits into 16 bit
+    constexpr uint32_t TIM_CLOCK = 36000000 / (PRESCALER + 1);
+    constexpr uint32_t FRAME_MS = 10;
+    constexpr uint8_t ATTACK_FRAMES = 2;
+    constexpr uint8_t RELEASE_FRAMES = 4;
+
+    /**
+     * Equal temperament from A4 = 440Hz, MIDI numbering, only evaluated by the compiler
+     */
+    constexpr double note_frequency(uint8_t note) {
+        double f = 440.0;
+        constexpr double semitone = 1.0594630943592953;
+        for (uint8_t n = 69; n < note; n++) f *= semitone;
+        for (uint8_t n = 69; n > note; n--) f /= semitone;
+        return f;
+    }
+
+    constexpr uint8_t LOWEST_NOTE = 48; // C3
+    constexpr uint8_t NOTE_COUNT = 48; // Up to B6
+
+    struct period_table_t {
+        uint16_t arr[NOTE_COUNT];
+    };
+
+    constexpr period_table_t make_periods() {
+        period_table_t table{};
+        for (uint8_t i = 0; i < NOTE_COUNT; i++) {
+            table.arr[i] = static_cast<uint16_t>(TIM_CLOCK / note_frequency(static_cast<uint8_t>(LOWEST_NOTE + i)) - 0.5);
+        }
+        return table;
+    }
+
+    constexpr period_table_t periods = make_periods();
+    static_assert(TIM_CLOCK / note_frequency(LOWEST_NOTE) < 65536);
+
+    /**
+     * Note 0 is a rest, length in sixteenths
+     */
+    struct note_t {
+        uint8_t note;
+        uint8_t sixteenths;
+    };
+
+    struct melody_t {
+        const note_t *notes;
+        uint8_t count;
+        uint8_t frames_per_sixteenth; // Tempo
+    };
+
+    constexpr note_t wake_notes[] = {
+        {72, 2}, {76, 2}, {79, 2}, {84, 4}, {0, 2}, {79, 2}, {84, 6}, {0, 8},
+    };
+    constexpr note_t chime_notes[] = {
+        {76, 4}, {72, 4}, {74, 4}, {67, 8}, {0, 4}, {67, 4}, {74, 4}, {76, 4}, {72, 8}, {0, 8},
+    };
+    constexpr note_t beep_notes[] = {
+        {88, 3}, {0, 3}, {88, 3}, {0, 3}, {88, 3}, {0, 15},
+    };
+
+    constexpr melody_t melodies[] = {
+        {wake_notes, sizeof(wake_notes) / sizeof(note_t), 12},
+        {chime_notes, sizeof(chime_notes) / sizeof(note_t), 10},
+        {beep_notes, sizeof(beep_notes) / sizeof(note_t), 5},
+    };
+    constexpr uint8_t MELODY_COUNT = sizeof(melodies) / sizeof(melodies[0]);
+
+    const melody_t *melody;
+    uint8_t index;
+    uint16_t note_frames, frame;
+    uint8_t volume; // 0..255, scales the duty up to 50%
+    uint8_t volume_max;
+    uint8_t volume_step; // Added each time the melody repeats, for escalation
+    bool repeat;
+    bool locked;
+    timers::timer_t timer;
+
+    void init() {
+        AFIO->MAPR = (AFIO->MAPR & ~AFIO_MAPR_TIM2_REMAP) | AFIO_MAPR_TIM2_REMAP_PARTIALREMAP1
+                   | AFIO_MAPR_SWJ_CFG_JTAGDISABLE; // SWJ_CFG reads back undefined, always write it, SWD stays
+        tim::set_prescaler(TIM, PRESCALER);
+        tim::set_period(TIM, 0xffff);
+        TIM->CCMR1 = (TIM->CCMR1 & ~(TIM_CCMR1_OC1M | TIM_CCMR1_CC1S)) | TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE;
+        TIM->CCR1 = 0;
+        TIM->CCER |= TIM_CCER_CC1E;
+        TIM->CR1 |= TIM_CR1_ARPE;
+        tim::generate_update(TIM);
+        gpio::reset(GPIOA, 15);
+        gpio::config(GPIOA, 15, gpio::AF_PUSHPULL, gpio::SPEED_2MHZ);
+    }
+
+    /**
+     * Sets a tone directly, note 0 or volume 0 is silence
+     */
+    void tone(uint8_t note, uint8_t level) {
+        if (!note || !level || note < LOWEST_NOTE || note >= LOWEST_NOTE + NOTE_COUNT) {
+            TIM->CCR1 = 0;
+            return;
+        }
+        uint16_t arr = periods.arr[note - LOWEST_NOTE];
+        TIM->ARR = arr;
+        TIM->CCR1 = (arr + 1UL) * level >> 9;
+        if (!(TIM->CR1 & TIM_CR1_CEN)) {
+            tim::enable(TIM);
+        }
+    }
+
+    void start_note() {
+        const note_t &n = melody->notes[index];
+        note_frames = static_cast<uint16_t>(n.sixteenths * melody->frames_per_sixteenth);
+        frame = 0;
+    }
+
+    void stop() {
+        if (!locked) {
+            return; // Not playing, TIM2 may belong to audio.h or speaker.h
+        }
+        timers::cancel(timer);
+        TIM->CCR1 = 0;
+        tim::disable(TIM);
+        power::unlock();
+        locked = false;
+    }
+
+    /**
+     * Timer callback, one envelope step
+     */
+    void step(uint32_t) {
+        if (frame >= note_frames) {
+            if (++index >= melody->count) {
+                if (!repeat) {
+                    stop();
+                    return;
+                }
+                index = 0;
+                volume = static_cast<uint8_t>(volume_max - volume > volume_step ? volume + volume_step : volume_max);
+            }
+            start_note();
+        }
+        uint32_t envelope = 256;
+        if (frame < ATTACK_FRAMES) {
+            envelope = (frame + 1UL) * 256 / (ATTACK_FRAMES + 1);
+        } else if (note_frames - frame <= RELEASE_FRAMES) {
+            envelope = (note_frames - frame) * 256UL / (RELEASE_FRAMES + 1);
+        }
+        tone(melody->notes[index].note, static_cast<uint8_t>(volume * envelope >> 8));
+        frame++;
+    }
+
+    /**
+     * Plays a melody, repeating ones get louder by step each round up to max, a gentle alarm escalation
+     */
+    void play(uint8_t id, uint8_t start_volume, uint8_t max_volume, uint8_t step_volume, bool repeating) {
+        if (id >= MELODY_COUNT) {
+            return;
+        }
+        stop();
+        melody = &melodies[id];
+        index = 0;
+        volume = start_volume;
+        volume_max = max_volume < start_volume ? start_volume : max_volume;
+        volume_step = step_volume;
+        repeat = repeating;
+        start_note();
+        power::lock(); // TIM2 stops in STOP mode
+        locked = true;
+        timers::start(timer, FRAME_MS, step, 0, FRAME_MS);
+    }
+
+    bool playing() {
+        return timers::active(timer);
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_BUZZER_H
@@ -0,0 +1,190 @@
+/**
+ * @file cct.h
+ * Warm/cold color temperature mixer in fixed point.\n
+ * The light is commanded as perceptual level and CCT. The level gives the total luminance, which is split
+ * between the channels by mixing linearly in mired, so perceived brightness stays the same while the CCT changes.
+ * Per frame cost is a table lookup, three 32x32 multiplies and the dithering, no division.
+ * After another engine drove the LEDs, level and CCT are taken back from pwm::output, so fades start from what is lit.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_CCT_H
+#define ALARM_CLOCK_LAMP_CCT_H
+
+#include "brightness.h"
+
+namespace cct {
+    /**
+     * Measured per LED batch. Gains equalize the channels luminous output per duty,
+     * the more efficient channel is scaled down (0x10000 = 1.0)
+     */
+    struct calibration_t {
+        uint16_t warm_kelvin;
+        uint16_t cold_kelvin;
+        uint32_t warm_gain_q16;
+        uint32_t cold_gain_q16;
+    };
+
+    constexpr calibration_t batches[] = {
+        {2700, 6500, 0x10000, 0x10000}, // Uncalibrated nominal values, add a row per measured batch
+    };
+    constexpr uint8_t BATCH_COUNT = sizeof(batches) / sizeof(batches[0]);
+
+    const calibration_t *calibration = &batches[0];
+    uint32_t warm_mired_q16, cold_mired_q16;
+    uint32_t share_per_mired_q16; // Cold share per mired, 1.0 = 0x10000
+
+    uint32_t level, mired; // 16.16, level is perceptual
+    uint32_t level_step, mired_step;
+    uint16_t level_target;
+    uint32_t mired_target;
+    uint32_t remaining;
+    brightness::dither_t warm_dither, cold_dither;
+
+    uint32_t scale_q16(uint32_t value, uint32_t factor_q16) {
+        return static_cast<uint32_t>(static_cast<uint64_t>(value) * factor_q16 >> 16);
+    }
+
+    uint32_t kelvin_to_mired_q16(uint16_t kelvin) {
+        return (1000000UL << 4) / kelvin << 12;
+    }
+
+    /**
+     * Clamps the CCT into the range the two channels can mix
+     */
+    uint32_t clamp_mired(uint16_t kelvin) {
+        if (kelvin < calibration->warm_kelvin) kelvin = calibration->warm_kelvin;
+        if (kelvin > calibration->cold_kelvin) kelvin = calibration->cold_kelvin;
+        return kelvin_to_mired_q16(kelvin);
+    }
+
+    void select_batch(uint8_t batch) {
+        irq::critical_section cs;
+        calibration = &batches[batch < BATCH_COUNT ? batch : 0];
+        warm_mired_q16 = kelvin_to_mired_q16(calibration->warm_kelvin);
+        cold_mired_q16 = kelvin_to_mired_q16(calibration->cold_kelvin);
+        share_per_mired_q16 = (0x10000UL << 8) / ((warm_mired_q16 - cold_mired_q16) >> 8);
+    }
+
+    /**
+     * PWM stream source, advances the fade, splits the luminance and dithers each channel
+     */
+    void fill(pwm::frame_t *frames, uint16_t count) {
+        uint32_t warm_q8 = 0, cold_q8 = 0;
+        for (uint16_t i = 0; i < count; i++) {
+            if (remaining) {
+                remaining--;
+                level += level_step;
+                mired += mired_step;
+                if (!remaining) {
+                    level = static_cast<uint32_t>(level_target) << 16;
+                    mired = mired_target;
+                }
+            }
+            uint32_t luminance = brightness::to_duty_q8(static_cast<uint16_t>(level >> 16));
+            uint32_t offset = mired < warm_mired_q16 ? warm_mired_q16 - mired : 0;
+            uint32_t cold_share = scale_q16(offset, share_per_mired_q16);
+            if (cold_share > 0x10000) cold_share = 0x10000;
+            uint32_t cold = scale_q16(luminance, cold_share);
+            warm_q8 = scale_q16(luminance - cold, calibration->warm_gain_q16);
+            cold_q8 = scale_q16(cold, calibration->cold_gain_q16);
+            frames[i].warm = warm_dither.next(warm_q8);
+            frames[i].cold = cold_dither.next(cold_q8);
+        }
+        pwm::output = {warm_q8, cold_q8};
+    }
+
+    /**
+     * Luminance of a channel in duty units, the inverse of its gain
+     */
+    uint32_t luminance_of(uint32_t duty_q8, uint32_t gain_q16) {
+        uint32_t luminance = (duty_q8 >> 8 << 16) / gain_q16;
+        return luminance > pwm::DUTY_MAX ? pwm::DUTY_MAX : luminance;
+    }
+
+    /**
+     * Takes level and CCT over from pwm::output if another engine drove the LEDs. Keeps the CCT while dark
+     */
+    void sync() {
+        irq::critical_section cs; // The running source writes pwm::output in the DMA interrupt
+        if (pwm::source == fill) {
+            return;
+        }
+        uint32_t warm = luminance_of(pwm::output.warm_q8, calibration->warm_gain_q16);
+        uint32_t cold = luminance_of(pwm::output.cold_q8, calibration->cold_gain_q16);
+        uint32_t luminance = warm + cold;
+        if (luminance > pwm::DUTY_MAX) luminance = pwm::DUTY_MAX; // Both channels at once are brighter than the mixer goes
+        remaining = 0;
+        level = static_cast<uint32_t>(brightness::to_level(luminance << 8)) << 16;
+        if (warm || cold) {
+            uint32_t cold_share = (cold << 16) / (warm + cold);
+            mired = warm_mired_q16 - ((cold_share << 15) / share_per_mired_q16 << 1); // Inverse of fill(), same rounding
+        }
+    }
+
+    /**
+     * Current perceptual level, taken over from pwm::output if another engine drove the LEDs
+     */
+    uint16_t current() {
+        sync();
+        return static_cast<uint16_t>(level >> 16);
+    }
+
+    /**
+     * Fades level and CCT together from the current output, the CCT moves linearly in mired
+     */
+    void fade(uint16_t to_level, uint16_t kelvin, uint32_t duration_ms) {
+        uint32_t frames = pwm::frames_in(duration_ms);
+        uint32_t to_mired = clamp_mired(kelvin);
+        sync();
+        irq::critical_section cs; // fill() runs in the DMA interrupt
+        if (!level) {
+            mired = to_mired; // Light was off, do not sweep the color
+        }
+        level_step = pwm::ramp::step(static_cast<uint16_t>(level >> 16), to_level, frames);
+        mired_step = to_mired > mired ? (to_mired - mired) / frames : 0 - (mired - to_mired) / frames;
+        level_target = to_level;
+        mired_target = to_mired;
+        remaining = frames;
+        if (pwm::source != fill) {
+            pwm::stream(fill);
+        }
+    }
+
+    /**
+     * Sets level and CCT, level 0 turns the stream off so STOP mode is possible again
+     */
+    void set(uint16_t to_level, uint16_t kelvin) {
+        if (!to_level) {
+            irq::critical_section cs;
+            remaining = 0;
+            level = 0;
+            pwm::set(0, 0);
+            return;
+        }
+        fade(to_level, kelvin, 0);
+    }
+
+    /**
+     * Current CCT, only the division of the conversion
+     */
+    uint16_t kelvin() {
+        return static_cast<uint16_t>((1000000UL << 12) / (mired >> 4));
+    }
+
+    /**
+     * Ends a running fade at the current output
+     */
+    void hold() {
+        irq::critical_section cs;
+        remaining = 0;
+    }
+
+    void init() {
+        select_batch(0);
+        mired = warm_mired_q16;
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_CCT_H
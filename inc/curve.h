@@ -0,0 +1,265 @@
+/**
+ * @file curve.h
+ * Keyframe curves for level and CCT, e.g. sunrise or evening scenes.\n
+ * A curve is a byte stream of keyframes, each one a fade to its level and CCT over its duration.
+ * Values are delta encoded as zigzag varints, a keyframe usually takes 4-6 bytes.
+ * Playback decodes one keyframe per segment and hands it to cct::fade, which does the per frame work
+ * with accumulators, so there is no work at all per tick and one division per segment.
+ * Built in curves live in .rodata, uploaded ones in the storage pages of the flash.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_CURVE_H
+#define ALARM_CLOCK_LAMP_CURVE_H
+
+#include "cct.h"
+#include "timers.h"
+
+namespace curve {
+    struct keyframe_t {
+        uint32_t duration_ms; // Fade time from the previous keyframe
+        uint16_t level;
+        uint16_t kelvin;
+    };
+
+    struct curve_t {
+        const uint8_t *data;
+        uint16_t length;
+    };
+
+    /**
+     * Compile time encoder for the built in curves
+     */
+    template<uint16_t N>
+    struct encoded_t {
+        uint8_t data[N * 11]; // Worst case 5 + 3 + 3 bytes per keyframe
+        uint16_t length;
+
+        constexpr void put_varint(uint32_t value) {
+            while (value >= 0x80) {
+                data[length++] = static_cast<uint8_t>(value | 0x80);
+                value >>= 7;
+            }
+            data[length++] = static_cast<uint8_t>(value);
+        }
+
+        constexpr void put_delta(uint16_t from, uint16_t to) {
+            int32_t delta = static_cast<int32_t>(to) - from;
+            put_varint(static_cast<uint32_t>(delta) << 1 ^ static_cast<uint32_t>(delta >> 31));
+        }
+
+        constexpr curve_t curve() const {
+            return {data, length};
+        }
+    };
+
+    template<uint16_t N>
+    constexpr encoded_t<N> encode(const keyframe_t (&frames)[N]) {
+        encoded_t<N> encoded{};
+        uint16_t level = 0, kelvin = 0;
+        for (const keyframe_t &frame : frames) {
+            encoded.put_varint(frame.duration_ms);
+            encoded.put_delta(level, frame.level);
+            encoded.put_delta(kelvin, frame.kelvin);
+            level = frame.level;
+            kelvin = frame.kelvin;
+        }
+        return encoded;
+    }
+
+    constexpr keyframe_t sunrise_weekday_frames[] = {
+        {0, 0, 2200},
+        {2000, 2000, 2200},
+        {600000, 16000, 2700}, // Deep red dawn for the first 10 minutes
+        {600000, 36000, 3500},
+        {600000, 58000, 5000},
+        {300000, 65535, 6500},
+    };
+    constexpr keyframe_t sunrise_weekend_frames[] = {
+        {0, 0, 2200},
+        {5000, 1500, 2200},
+        {1200000, 12000, 2500},
+        {1200000, 30000, 3000},
+        {900000, 48000, 4000},
+    };
+    constexpr keyframe_t evening_frames[] = {
+        {3000, 40000, 3000},
+        {900000, 20000, 2500},
+        {600000, 6000, 2200},
+        {300000, 0, 2200},
+    };
+
+    constexpr auto sunrise_weekday = encode(sunrise_weekday_frames);
+    constexpr auto sunrise_weekend = encode(sunrise_weekend_frames);
+    constexpr auto evening = encode(evening_frames);
+
+    constexpr curve_t builtins[] = {sunrise_weekday.curve(), sunrise_weekend.curve(), evening.curve()};
+    constexpr uint8_t BUILTIN_COUNT = sizeof(builtins) / sizeof(builtins[0]);
+
+    /**
+     * Uploaded curves, one flash page per slot starting with the u16 length.
+     * The length is programmed last, an interrupted upload stays empty (0xffff)
+     */
+    namespace store {
+        constexpr uint32_t BASE = flash::STORAGE; // Storage pages 0-3
+        constexpr uint8_t SLOTS = 4;
+        constexpr uint16_t CAPACITY = flash::PAGE_SIZE - 2;
+
+        uint32_t slot_address(uint8_t slot) {
+            return BASE + slot * flash::PAGE_SIZE;
+        }
+
+        curve_t get(uint8_t slot) {
+            const uint8_t *page = reinterpret_cast<const uint8_t *>(slot_address(slot));
+            uint16_t length = static_cast<uint16_t>(page[0] | page[1] << 8);
+            return {page + 2, length > CAPACITY ? static_cast<uint16_t>(0) : length};
+        }
+
+        bool erase(uint8_t slot) {
+            return slot < SLOTS && flash::erase_page(slot_address(slot));
+        }
+
+        /**
+         * @param offset Even byte offset into the curve data
+         */
+        bool write(uint8_t slot, uint16_t offset, const uint8_t *data, uint8_t length) {
+            if (slot >= SLOTS || (offset & 1) || offset + length > CAPACITY) {
+                return false;
+            }
+            return flash::program(slot_address(slot) + 2 + offset, data, length);
+        }
+
+        bool commit(uint8_t slot, uint16_t length) {
+            if (slot >= SLOTS || length > CAPACITY) {
+                return false;
+            }
+            uint8_t header[2] = {static_cast<uint8_t>(length), static_cast<uint8_t>(length >> 8)};
+            return flash::program(slot_address(slot), header, 2);
+        }
+    }
+
+    /**
+     * Curve ids are the built in curves first, then the store slots
+     */
+    curve_t get(uint8_t id) {
+        if (id < BUILTIN_COUNT) {
+            return builtins[id];
+        }
+        if (id - BUILTIN_COUNT < store::SLOTS) {
+            return store::get(static_cast<uint8_t>(id - BUILTIN_COUNT));
+        }
+        return {nullptr, 0};
+    }
+
+    /**
+     * Incremental decoder, never reads past the end of a corrupt curve
+     */
+    struct decoder_t {
+        const uint8_t *cursor;
+        const uint8_t *end;
+        uint16_t level;
+        uint16_t kelvin;
+
+        void reset(const curve_t &c) {
+            cursor = c.data;
+            end = c.data + c.length;
+            level = 0;
+            kelvin = 0;
+        }
+
+        bool varint(uint32_t &value) {
+            value = 0;
+            for (uint8_t shift = 0; shift < 35; shift += 7) {
+                if (cursor >= end) {
+                    return false;
+                }
+                uint8_t byte = *cursor++;
+                value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool delta(uint16_t &value) {
+            uint32_t zigzag;
+            if (!varint(zigzag)) {
+                return false;
+            }
+            value = static_cast<uint16_t>(value + ((zigzag >> 1) ^ (0 - (zigzag & 1))));
+            return true;
+        }
+
+        bool next(keyframe_t &frame) {
+            if (!varint(frame.duration_ms) || !delta(level) || !delta(kelvin)) {
+                return false;
+            }
+            frame.level = level;
+            frame.kelvin = kelvin;
+            return true;
+        }
+    };
+
+    decoder_t decoder;
+    timers::timer_t timer;
+    bool looping;
+    curve_t current;
+
+    /**
+     * Starts the next segment, timer callback
+     */
+    void advance(uint32_t) {
+        keyframe_t frame{};
+        if (!decoder.next(frame)) {
+            if (!looping) {
+                if (!decoder.level) {
+                    cct::set(0, 0); // Ended dark, release the stream
+                }
+                return;
+            }
+            decoder.reset(current);
+            if (!decoder.next(frame)) {
+                return;
+            }
+        }
+        cct::fade(frame.level, frame.kelvin, frame.duration_ms);
+        timers::start(timer, frame.duration_ms, advance);
+    }
+
+    /**
+     * Plays a curve from the current light output
+     * @param loop Restarts at the end, for scenes
+     * @return false for an unknown id or an empty slot
+     */
+    bool play(uint8_t id, bool loop = false) {
+        curve_t c = get(id);
+        if (!c.length) {
+            return false;
+        }
+        timers::cancel(timer);
+        current = c;
+        looping = loop;
+        decoder.reset(c);
+        advance(0);
+        return true;
+    }
+
+    bool playing() {
+        return timers::active(timer);
+    }
+
+    /**
+     * Stops at the current output
+     */
+    void stop() {
+        if (!playing()) {
+            return;
+        }
+        timers::cancel(timer);
+        cct::hold();
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_CURVE_H
@@ -0,0 +1,246 @@
+/**
+ * @file effects.h
+ * Small lighting effects for radio commands: fade, breathe, candle and notify flash.\n
+ * Effects are evaluated every TICK_MS in fixed point and output a level and CCT, cct::fade interpolates
+ * in between. There are two effect slots, a new effect is set up in the back slot and crossfaded in,
+ * the previous one keeps its state so a finished notify flash fades back into it.
+ * Each tick is measured against a cycle budget, an overrun ends a crossfade early to halve the work.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_EFFECTS_H
+#define ALARM_CLOCK_LAMP_EFFECTS_H
+
+#include "cct.h"
+#include "timers.h"
+
+namespace effects {
+    enum effect_t : uint8_t {
+        NONE, // Holds its level and CCT
+        FADE, // To level and CCT in time_ms
+        BREATHE, // Between extra * 256 and level, period time_ms
+        CANDLE, // Flicker below level, depth extra * 256
+        NOTIFY, // extra flashes at level, time_ms on and off
+        EFFECT_COUNT
+    };
+
+    struct params_t {
+        uint16_t level;
+        uint16_t kelvin;
+        uint16_t time_ms;
+        uint8_t extra;
+    };
+
+    struct output_t {
+        uint16_t level;
+        uint16_t kelvin;
+    };
+
+    struct state_t {
+        effect_t effect;
+        params_t params;
+        uint32_t value; // 16.16 level for FADE and CANDLE, phase for BREATHE, halves left for NOTIFY
+        uint32_t step;
+        uint32_t ticks; // Remaining for FADE and the NOTIFY half
+        uint32_t kelvin; // 16.16 for FADE
+        uint32_t kelvin_step;
+        bool done;
+    };
+
+    struct stats_t {
+        uint32_t ticks;
+        uint32_t cycles_last;
+        uint32_t cycles_max;
+        uint32_t overruns;
+    };
+
+    constexpr uint32_t TICK_MS = 10;
+    constexpr uint32_t BUDGET_CYCLES = 3600; // 100us, 1% of the tick
+    constexpr uint32_t CROSSFADE_STEP = 0x10000 / 50; // 500ms
+
+    state_t slots[2];
+    uint8_t front;
+    uint32_t crossfade; // Weight of the front slot in 16.16, 0x10000 when not crossfading
+    uint32_t random_state = 0x2545f491;
+    timers::timer_t timer;
+    stats_t stats;
+
+    /**
+     * xorshift32, a few cycles and good enough for flicker
+     */
+    uint32_t random() {
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+        return random_state;
+    }
+
+    uint16_t mix(uint16_t from, uint16_t to, uint32_t weight_q16) {
+        return static_cast<uint16_t>(from + ((static_cast<int32_t>(to) - from) * static_cast<int32_t>(weight_q16 >> 1) >> 15));
+    }
+
+    /**
+     * Sets up an effect, the only place with divisions
+     */
+    void setup(state_t &s, effect_t effect, const params_t &params, output_t current) {
+        s = {};
+        s.effect = effect;
+        s.params = params;
+        uint32_t ticks = params.time_ms / TICK_MS;
+        if (!ticks) ticks = 1;
+        switch (effect) {
+            case FADE:
+                s.value = static_cast<uint32_t>(current.level) << 16;
+                s.step = pwm::ramp::step(current.level, params.level, ticks);
+                s.ticks = ticks;
+                s.kelvin = static_cast<uint32_t>(current.kelvin) << 16;
+                s.kelvin_step = pwm::ramp::step(current.kelvin, params.kelvin, ticks);
+                break;
+            case BREATHE:
+                s.step = 0xffffffffUL / ticks;
+                break;
+            case CANDLE:
+                s.value = static_cast<uint32_t>(params.level) << 16;
+                break;
+            case NOTIFY:
+                s.value = 2 * static_cast<uint32_t>(params.extra);
+                s.step = ticks;
+                s.ticks = ticks;
+                break;
+            default:
+                break;
+        }
+    }
+
+    output_t run(state_t &s) {
+        const params_t &p = s.params;
+        switch (s.effect) {
+            case FADE:
+                if (s.ticks) {
+                    s.ticks--;
+                    s.value += s.step;
+                    s.kelvin += s.kelvin_step;
+                    if (!s.ticks) {
+                        s.value = static_cast<uint32_t>(p.level) << 16;
+                        s.kelvin = static_cast<uint32_t>(p.kelvin) << 16;
+                        s.done = true;
+                    }
+                }
+                return {static_cast<uint16_t>(s.value >> 16), static_cast<uint16_t>(s.kelvin >> 16)};
+            case BREATHE: {
+                s.value += s.step;
+                uint32_t t = s.value >> 15; // Triangle 0..0xffff..0
+                if (t > 0xffff) t = 0x1ffff - t;
+                uint32_t t2 = t * t >> 16;
+                uint32_t smooth = 3 * t2 - 2 * (t2 * t >> 16); // Smoothstep, 0..0xffff
+                uint16_t low = static_cast<uint16_t>(p.extra << 8);
+                return {mix(low, p.level, smooth), p.kelvin};
+            }
+            case CANDLE: {
+                uint32_t r = random();
+                uint32_t depth = static_cast<uint32_t>(p.extra) << 8;
+                uint32_t dip = depth * (r >> 24) >> 8;
+                if ((r & 0xff) < 24) dip = depth; // Occasional gust
+                uint32_t target = (p.level > dip ? p.level - dip : 0) << 16;
+                if (target > s.value) {
+                    s.value += (target - s.value) >> 2; // First order low pass
+                } else {
+                    s.value -= (s.value - target) >> 2;
+                }
+                uint16_t jitter = static_cast<uint16_t>(p.kelvin > 0x3f ? (r >> 8) & 0x3f : 0);
+                return {static_cast<uint16_t>(s.value >> 16), static_cast<uint16_t>(p.kelvin - jitter)};
+            }
+            case NOTIFY: {
+                if (!s.value) {
+                    s.done = true;
+                    return {0, p.kelvin};
+                }
+                output_t out = {static_cast<uint16_t>(s.value & 1 ? 0 : p.level), p.kelvin};
+                if (!--s.ticks) {
+                    s.value--;
+                    s.ticks = s.step;
+                }
+                return out;
+            }
+            default:
+                s.done = true; // Nothing to animate, stops once it is not crossfaded any more
+                return {p.level, p.kelvin};
+        }
+    }
+
+    bool running() {
+        return timers::active(timer);
+    }
+
+    /**
+     * Stops at the current output, switches the light off if that is dark
+     */
+    void stop() {
+        if (!running()) {
+            return;
+        }
+        timers::cancel(timer);
+        if (cct::current()) {
+            cct::hold();
+        } else {
+            cct::set(0, 0);
+        }
+    }
+
+    /**
+     * Timer callback, evaluates the effects and hands the result to cct
+     */
+    void tick(uint32_t) {
+        uint32_t start = DWT->CYCCNT;
+        state_t &current = slots[front];
+        output_t out = run(current);
+        if (crossfade < 0x10000) {
+            output_t back = run(slots[front ^ 1]);
+            crossfade += CROSSFADE_STEP;
+            if (crossfade > 0x10000) crossfade = 0x10000;
+            out.level = mix(back.level, out.level, crossfade);
+            out.kelvin = mix(back.kelvin, out.kelvin, crossfade);
+        } else if (current.done && current.effect == NOTIFY) {
+            front ^= 1; // Back to what ran before the flash
+            crossfade = 0;
+        } else if (current.done) {
+            stop(); // cct is already at the final output
+            return;
+        }
+        cct::fade(out.level, out.kelvin, TICK_MS);
+        stats.ticks++;
+        stats.cycles_last = DWT->CYCCNT - start;
+        if (stats.cycles_last > stats.cycles_max) stats.cycles_max = stats.cycles_last;
+        if (stats.cycles_last > BUDGET_CYCLES) {
+            stats.overruns++;
+            crossfade = 0x10000;
+        }
+    }
+
+    /**
+     * Crossfades from the current output into the effect
+     */
+    void start(effect_t effect, const params_t &params) {
+        if (effect >= EFFECT_COUNT) {
+            return;
+        }
+        output_t current = {cct::current(), cct::kelvin()};
+        if (!running()) {
+            setup(slots[front], NONE, {current.level, current.kelvin, 0, 0}, current);
+        }
+        front ^= 1;
+        setup(slots[front], effect, params, current);
+        crossfade = effect == FADE ? 0x10000 : 0; // A fade already starts at the current output
+        if (!running()) {
+            timers::start(timer, TICK_MS, tick, 0, TICK_MS);
+        }
+    }
+
+    void init() {
+        dwt::enable_cyccnt();
+        crossfade = 0x10000;
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_EFFECTS_H
@@ -0,0 +1,112 @@
+/**
+ * @file events.h
+ * Run to completion event loop. ISRs only post an event into a lock free multi producer queue,
+ * the actual work is done by the handlers in thread mode.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_EVENTS_H
+#define ALARM_CLOCK_LAMP_EVENTS_H
+
+#include "stm32f1xx.h"
+
+namespace events {
+    enum event_t : uint8_t {
+        NONE, // Marks an empty queue slot, never posted
+        RADIO_IRQ,
+        TIMER_EXPIRED,
+        ASYNC_RESUME,
+        BUTTON_EDGE,
+        BUTTON_GESTURE, // Argument: button | gesture << 8, see buttons.h
+        RTC_ALARM,
+        EVENT_COUNT
+    };
+
+    /**
+     * Handlers receive the 24 bit argument passed to post()
+     */
+    using handler_t = void (*)(uint32_t arg);
+
+    /**
+     * Called with interrupts masked when the queue is empty, must return after a wakeup
+     */
+    using idle_t = void (*)();
+
+    constexpr uint32_t QUEUE_SIZE = 16; // Must be a power of two
+
+    volatile uint32_t queue[QUEUE_SIZE]; // event id in the low byte, argument above, 0 = not yet written
+    volatile uint32_t head; // Next slot to claim, only modified with LDREX/STREX
+    volatile uint32_t tail; // Next slot to dispatch, only modified by the loop
+    volatile uint32_t dropped; // Events lost because the queue was full
+    handler_t handlers[EVENT_COUNT];
+    idle_t idle_hook;
+
+    void subscribe(event_t event, handler_t handler) {
+        handlers[event] = handler;
+    }
+
+    /**
+     * Queues an event, safe to call from any ISR priority and thread mode
+     * @param event what happened
+     * @param arg 24 bit argument for the handler
+     * @return false if the queue was full and the event got dropped
+     */
+    bool post(event_t event, uint32_t arg = 0) {
+        uint32_t slot;
+        do {
+            slot = __LDREXW(&head);
+            if (slot - tail >= QUEUE_SIZE) {
+                __CLREX();
+                dropped = dropped + 1;
+                return false;
+            }
+        } while (__STREXW(slot + 1, &head));
+        queue[slot & (QUEUE_SIZE - 1)] = event | arg << 8;
+        return true;
+    }
+
+    /**
+     * Dispatches queued events in order until the queue is empty.\n
+     * Stops early at a claimed but not yet written slot, the posting ISR finishes before we run again
+     */
+    void dispatch() {
+        while (tail != head) {
+            volatile uint32_t &entry = queue[tail & (QUEUE_SIZE - 1)];
+            uint32_t value = entry;
+            if (value == NONE) {
+                return;
+            }
+            entry = NONE;
+            tail = tail + 1;
+            handler_t handler = handlers[value & 0xff];
+            if (handler) {
+                handler(value >> 8);
+            }
+        }
+    }
+
+    bool pending() {
+        return queue[tail & (QUEUE_SIZE - 1)] != NONE;
+    }
+
+    /**
+     * Runs the event loop forever, sleeps with wfi when there is nothing to do
+     */
+    [[noreturn]] void run() {
+        while (true) {
+            dispatch();
+            __disable_irq();
+            if (!pending()) { // Wakes on a pending irq even with PRIMASK set, so no post can be missed
+                if (idle_hook) {
+                    idle_hook();
+                } else {
+                    __WFI();
+                }
+            }
+            __enable_irq();
+        }
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_EVENTS_H
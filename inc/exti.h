@@ -0,0 +1,137 @@
+/**
+ * @file exti.h
+ * Compile time registry of the GPIO EXTI lines and their handlers.\n
+ * The bindings are a constexpr table, registry_t checks it at compile time (one port per line, as AFIO->EXTICR
+ * can only select one) and builds the EXTICR values, the edge masks and the line to handler table from it.
+ * The vectors call dispatch() for their line range: a single line is a direct call, shared vectors
+ * find the pending lines with CLZ, highest line first, and clear each pending bit before its handler runs,
+ * so an edge during the handler pends again instead of getting lost.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_EXTI_H
+#define ALARM_CLOCK_LAMP_EXTI_H
+
+#include "peripherals.h"
+
+namespace exti {
+    using handler_t = void (*)();
+
+    enum edge_t : uint8_t {
+        FALLING = 1,
+        RISING = 2,
+        BOTH = 3
+    };
+
+    struct binding_t {
+        gpio::bank_t bank;
+        uint8_t line; // Same as the pin number
+        edge_t edge;
+        handler_t handler;
+    };
+
+    template<const auto &bindings>
+    struct registry_t {
+        static constexpr uint8_t LINES = 16;
+
+        static constexpr bool valid() {
+            uint32_t used = 0;
+            for (const binding_t &b : bindings) {
+                if (b.line >= LINES || (used & 1UL << b.line) || !b.handler) {
+                    return false;
+                }
+                used |= 1UL << b.line;
+            }
+            return true;
+        }
+        static_assert(valid(), "EXTI lines must be < 16, bound once and have a handler");
+
+        static constexpr uint32_t mask(uint8_t first, uint8_t last) {
+            uint32_t result = 0;
+            for (const binding_t &b : bindings) {
+                if (b.line >= first && b.line <= last) {
+                    result |= 1UL << b.line;
+                }
+            }
+            return result;
+        }
+
+        static constexpr uint32_t edges(edge_t edge) {
+            uint32_t result = 0;
+            for (const binding_t &b : bindings) {
+                if (b.edge & edge) {
+                    result |= 1UL << b.line;
+                }
+            }
+            return result;
+        }
+
+        struct exticr_t {
+            uint32_t value[4];
+            uint32_t mask[4];
+        };
+
+        static constexpr exticr_t exticr() {
+            exticr_t result{};
+            for (const binding_t &b : bindings) {
+                result.value[b.line / 4] |= static_cast<uint32_t>(b.bank) << (b.line % 4) * 4;
+                result.mask[b.line / 4] |= 0xfUL << (b.line % 4) * 4;
+            }
+            return result;
+        }
+
+        struct table_t {
+            handler_t handlers[LINES];
+        };
+
+        static constexpr table_t table() {
+            table_t result{};
+            for (const binding_t &b : bindings) {
+                result.handlers[b.line] = b.handler;
+            }
+            return result;
+        }
+
+        static constexpr table_t handlers = table();
+
+        /**
+         * Routes the lines to their ports, sets the edges and unmasks the lines
+         */
+        static void config() {
+            constexpr exticr_t cr = exticr();
+            for (uint8_t i = 0; i < 4; i++) {
+                if (cr.mask[i]) {
+                    MODIFY_REG(AFIO->EXTICR[i], cr.mask[i], cr.value[i]);
+                }
+            }
+            EXTI->FTSR |= edges(FALLING);
+            EXTI->RTSR |= edges(RISING);
+            EXTI->PR = mask(0, LINES - 1);
+            EXTI->IMR |= mask(0, LINES - 1);
+        }
+
+        /**
+         * Call from the vector of lines first..last. Lines masked by their driver stay pending and are skipped
+         */
+        template<uint8_t first, uint8_t last>
+        static void dispatch() {
+            constexpr uint32_t lines = mask(first, last);
+            static_assert(lines, "No handler registered for this vector");
+            if constexpr ((lines & (lines - 1)) == 0) {
+                constexpr uint8_t line = 31 - __builtin_clz(lines);
+                EXTI->PR = lines;
+                handlers.handlers[line]();
+            } else {
+                uint32_t pending;
+                while ((pending = EXTI->PR & EXTI->IMR & lines)) {
+                    uint8_t line = static_cast<uint8_t>(31 - __CLZ(pending));
+                    EXTI->PR = 1UL << line;
+                    handlers.handlers[line]();
+                }
+            }
+        }
+    };
+}
+
+#endif //ALARM_CLOCK_LAMP_EXTI_H
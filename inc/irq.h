@@ -0,0 +1,156 @@
+/**
+ * @file irq.h
+ * Central interrupt priority plan and BASEPRI based critical sections.\n
+ * All 4 priority bits are used for preemption. Critical sections never mask the SAFETY level,
+ * so the All-off button always gets through.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_IRQ_H
+#define ALARM_CLOCK_LAMP_IRQ_H
+
+#include "peripherals.h"
+
+namespace irq {
+    /**
+     * Preemption levels, lower is more urgent. DMA completion is above the radio,
+     * a late refill is audible/visible while the radio ISR only posts an event
+     */
+    enum level_t : uint8_t {
+        SAFETY,
+        DMA,
+        RADIO,
+        TIMER,
+        LEVEL_COUNT,
+        BACKGROUND = 15
+    };
+
+    struct entry_t {
+        IRQn_Type irqn;
+        level_t level;
+    };
+
+    constexpr entry_t priority_map[] = {
+        {EXTI15_10_IRQn, SAFETY}, // On/Off and All-off buttons
+        {DMA1_Channel2_IRQn, DMA}, // nRF SPI RX complete
+        {DMA1_Channel6_IRQn, DMA}, // LED PWM ring refill
+        {I2C2_EV_IRQn, DMA}, // TEA I2C events, some must be handled within one byte time
+        {I2C2_ER_IRQn, DMA},
+        {DMA1_Channel5_IRQn, DMA}, // TEA I2C RX complete
+        {EXTI3_IRQn, RADIO}, // nRF IRQ
+        {DMA1_Channel7_IRQn, RADIO}, // Audio ring refill, the ADPCM decode would block the I2C events
+        {TIM3_IRQn, TIMER}, // Timebase compare
+        {TIM4_IRQn, TIMER}, // Timebase overflow and coarse compare
+        {RTC_Alarm_IRQn, TIMER}, // Only posts an event
+    };
+
+    /**
+     * Whether an exception handler runs, false in thread mode
+     */
+    bool in_handler() {
+        return SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk;
+    }
+
+    /**
+     * Applies the priority map, call before enabling any interrupt
+     */
+    void config() {
+        NVIC_SetPriorityGrouping(3); // 4 bits preemption, no subpriority
+        for (const entry_t &entry : priority_map) {
+            NVIC_SetPriority(entry.irqn, entry.level);
+        }
+    }
+
+    /**
+     * Masks all interrupts of the given level and below for its lifetime, nests correctly.\n
+     * The SAFETY level is never masked, use __disable_irq if that is really needed
+     */
+    class critical_section {
+        uint32_t saved;
+    public:
+        explicit critical_section(level_t level = DMA) : saved(__get_BASEPRI()) {
+            __set_BASEPRI_MAX(static_cast<uint32_t>(level < DMA ? DMA : level) << (8U - __NVIC_PRIO_BITS));
+        }
+
+        ~critical_section() {
+            __set_BASEPRI(saved);
+        }
+
+        critical_section(const critical_section &) = delete;
+        critical_section &operator=(const critical_section &) = delete;
+    };
+
+    /**
+     * Synthetic latency benchmark on unused vectors, define IRQ_BENCH to build it.\n
+     * A background ISR spins with and without critical sections and pends an ISR of each level
+     * at varying points, the entry latency in core cycles is recorded per level.
+     */
+    namespace bench {
+#ifdef IRQ_BENCH
+        constexpr bool enabled = true;
+#else
+        constexpr bool enabled = false;
+#endif
+        constexpr IRQn_Type vectors[LEVEL_COUNT] = {USB_HP_CAN1_TX_IRQn, USB_LP_CAN1_RX0_IRQn,
+                                                     CAN1_RX1_IRQn, CAN1_SCE_IRQn};
+        constexpr IRQn_Type load_vector = USART3_IRQn;
+
+        volatile uint32_t pend_cycles;
+        uint8_t target;
+        uint16_t round;
+        uint32_t worst[LEVEL_COUNT];
+
+        /**
+         * Call from the handler of vectors[level]
+         */
+        void target_irq(level_t level) {
+            uint32_t latency = DWT->CYCCNT - pend_cycles;
+            if (latency > worst[level]) worst[level] = latency;
+        }
+
+        void spin_and_pend(uint32_t spin, uint32_t trigger) {
+            for (volatile uint32_t i = 0; i < spin; i++) {
+                if (i == trigger) {
+                    pend_cycles = DWT->CYCCNT;
+                    NVIC_SetPendingIRQ(vectors[target]);
+                }
+            }
+        }
+
+        /**
+         * Call from the handler of load_vector
+         */
+        void load_irq() {
+            uint32_t spin = 16 + (round * 37U) % 512;
+            uint32_t trigger = (round * 13U) % spin;
+            if (round & 1) {
+                critical_section cs;
+                spin_and_pend(spin, trigger);
+            } else {
+                spin_and_pend(spin, trigger);
+            }
+        }
+
+        /**
+         * Runs the benchmark from thread mode, results accumulate in worst
+         */
+        void run(uint16_t rounds) {
+            if constexpr (enabled) {
+                dwt::enable_cyccnt();
+                for (uint8_t level = 0; level < LEVEL_COUNT; level++) {
+                    NVIC_SetPriority(vectors[level], level);
+                    NVIC_EnableIRQ(vectors[level]);
+                }
+                NVIC_SetPriority(load_vector, BACKGROUND);
+                NVIC_EnableIRQ(load_vector);
+                for (round = 0; round < rounds; round++) {
+                    target = static_cast<uint8_t>(round % LEVEL_COUNT);
+                    NVIC_SetPendingIRQ(load_vector); // Runs to completion right here, thread mode is below everything
+                }
+            }
+        }
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_IRQ_H
@@ -0,0 +1,114 @@
+/**
+ * @file latency.h
+ * Cycle accurate instrumentation of the radio receive path.\n
+ * Every stage is timestamped with the DWT cycle counter, the delay relative to the EXTI edge is
+ * accumulated into min/avg/max and a log2 histogram. Define LATENCY_STATS to enable, otherwise
+ * there is no storage and all calls compile to nothing.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_LATENCY_H
+#define ALARM_CLOCK_LAMP_LATENCY_H
+
+#include "peripherals.h"
+
+namespace latency {
+    enum stage_t : uint8_t {
+        EXTI_EDGE,
+        STATUS_READ,
+        PAYLOAD_DONE,
+        CMD_PARSED,
+        PWM_UPDATED,
+        STAGE_COUNT
+    };
+
+#ifdef LATENCY_STATS
+    /**
+     * Bucket i holds delays of [2^(i-1), 2^i) cycles, the last one everything above
+     */
+    constexpr uint8_t HIST_BUCKETS = 24;
+
+    struct stats_t {
+        uint32_t min = UINT32_MAX;
+        uint32_t max = 0;
+        uint64_t sum = 0;
+        uint32_t count = 0;
+        uint16_t hist[HIST_BUCKETS]{};
+    };
+
+    uint32_t stamps[STAGE_COUNT];
+    uint8_t stamped;
+    stats_t stats[STAGE_COUNT]; // EXTI_EDGE entry stays empty, it is the reference
+
+    void init() {
+        dwt::enable_cyccnt();
+    }
+
+    /**
+     * Records the current cycle count for a stage, costs a load and two stores
+     */
+    void stamp(stage_t stage) {
+        stamps[stage] = DWT->CYCCNT;
+        stamped |= 1 << stage;
+    }
+
+    /**
+     * Accumulates the stamps of the current packet into the statistics, call once the packet is fully handled
+     */
+    void commit() {
+        if (!(stamped & 1 << EXTI_EDGE)) {
+            stamped = 0;
+            return;
+        }
+        for (uint8_t i = EXTI_EDGE + 1; i < STAGE_COUNT; i++) {
+            if (!(stamped & 1 << i)) {
+                continue;
+            }
+            uint32_t delay = stamps[i] - stamps[EXTI_EDGE];
+            stats_t &s = stats[i];
+            if (delay < s.min) s.min = delay;
+            if (delay > s.max) s.max = delay;
+            s.sum += delay;
+            s.count++;
+            uint8_t bucket = static_cast<uint8_t>(32 - __CLZ(delay));
+            if (bucket >= HIST_BUCKETS) bucket = HIST_BUCKETS - 1;
+            if (s.hist[bucket] != UINT16_MAX) s.hist[bucket]++;
+        }
+        stamped = 0;
+    }
+
+    void reset() {
+        for (stats_t &s : stats) {
+            s.min = UINT32_MAX;
+            s.max = 0;
+            s.sum = 0;
+            s.count = 0;
+            for (uint16_t &h : s.hist) {
+                h = 0;
+            }
+        }
+    }
+
+    /**
+     * Scales sum and count down until the sum fits 32 bits, the M3 has no 64 bit divide
+     */
+    uint32_t average(const stats_t &s) {
+        uint64_t sum = s.sum;
+        uint32_t count = s.count;
+        while (sum >> 32) {
+            sum >>= 1;
+            count >>= 1;
+        }
+        return count ? static_cast<uint32_t>(sum) / count : 0;
+    }
+#else
+    void init() {}
+
+    void stamp(stage_t) {}
+
+    void commit() {}
+#endif
+}
+
+#endif //ALARM_CLOCK_LAMP_LATENCY_H
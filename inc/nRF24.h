@@ -12,6 +12,7 @@
 
 class nRF24 {
     SPI_Handler *spi_handler;
+    uint8_t reg_buffer[2]; // Must outlive non blocking register writes
 public:
     void set_spi_handler(SPI_Handler *handler) {
         spi_handler = handler;
@@ -106,6 +107,17 @@ public:
         spi_handler->write_transaction(buffer, 2, true);
     }
 
+    /**
+     * A non blocking write to a nRF register, completion is signaled by the SPI handlers callback
+     * @param reg The register to write to
+     * @param byte data to write
+     */
+    void write_reg_async(regs_t reg, uint8_t byte) {
+        reg_buffer[0] = static_cast<uint8_t>(reg | 1 << 5);
+        reg_buffer[1] = byte;
+        spi_handler->write_transaction(reg_buffer, 2, false);
+    }
+
     /**
      * A blocking write of multiple bytes to a nRF register
      * @param reg The register to write to
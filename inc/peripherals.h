@@ -25,6 +25,19 @@ namespace rcc {
         RCC->CFGR |= RCC_CFGR_SW_PLL; // Switch SYSCLK source to PLL
         while (!(RCC->CR & RCC_CR_PLLRDY)); // Wait for PLL to stabilize
     }
+
+    /**
+     * Fast path back to the 72MHz PLL clock after STOP mode, which falls back to HSI.\n
+     * Dividers, PLL multiplier and FLASH wait states are retained, only oscillators and the switch are restored
+     */
+    void restore_hse_pll_after_stop() {
+        RCC->CR |= RCC_CR_HSEON;
+        while (!(RCC->CR & RCC_CR_HSERDY));
+        RCC->CR |= RCC_CR_PLLON;
+        while (!(RCC->CR & RCC_CR_PLLRDY));
+        RCC->CFGR |= RCC_CFGR_SW_PLL;
+        while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL);
+    }
 }
 
 namespace gpio {
@@ -78,7 +91,8 @@ namespace gpio {
      */
     template<gpio::bank_t bank, uint8_t pin>
     void exti_enable_falling_irq() {
-        MODIFY_REG(AFIO->EXTICR[pin / 4], 0xf << (pin % 4), bank << (pin % 4));
+        static_assert(pin < 16);
+        MODIFY_REG(AFIO->EXTICR[pin / 4], 0xf << (pin % 4) * 4, bank << (pin % 4) * 4);
         EXTI->IMR |= 0x1 << pin;
         EXTI->FTSR |= 0x1 << pin;
     }
@@ -105,27 +119,109 @@ namespace tim {
         TIM->EGR |= TIM_EGR_UG;
         TIM->SR = 0;
     }
+}
+
+/**
+ * Cycle accurate delays and deadlines on the DWT cycle counter.\n
+ * CYCCNT wraps every ~119s and stops in STOP mode, 64 bit timestamps come from timebase::now_us()
+ */
+namespace dwt {
+    constexpr uint32_t CYCLES_PER_US = 36; // HCLK = SYSCLK/2, see rcc::clock_init_hse_pll_72MHz
 
     /**
-     * Configures the timer in oneshot mode
-     * @param prescaler clock divisor + 1
+     * Wraparound safe timeout, valid for up to 2^32 cycles (~119s)
      */
-    void config_oneshot(TIM_TypeDef *TIM, uint16_t prescaler, uint16_t period) {
-        set_period(TIM, period);
-        set_prescaler(TIM, prescaler);
-        generate_update(TIM);
-        TIM->CR1 |= TIM_CR1_OPM;
+    struct deadline_t {
+        uint32_t start;
+        uint32_t cycles;
+    };
+
+    /**
+     * Enables the DWT cycle counter, which counts HCLK cycles
+     */
+    void enable_cyccnt() {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    uint32_t cycles() {
+        return DWT->CYCCNT;
+    }
+
+    void delay_cycles(uint32_t cycles) {
+        uint32_t start = DWT->CYCCNT;
+        while (DWT->CYCCNT - start < cycles);
     }
 
     /**
-     * This function busy waits for the specified period using a timer
-     * @warning Reset timer config before using it elsewhere
+     * Busy waits at least the given time, meant for sub millisecond waits like nRF CE pulses
      */
-    void blocking_delay(TIM_TypeDef *TIM, uint16_t prescaler, uint16_t period) {
-        config_oneshot(TIM, prescaler, period);
-        enable(TIM);
-        while (TIM->CNT < period);
-        TIM->SR = 0;
+    void delay_us(uint32_t us) {
+        delay_cycles(us * CYCLES_PER_US);
+    }
+
+    deadline_t deadline_us(uint32_t us) {
+        return {DWT->CYCCNT, us * CYCLES_PER_US};
+    }
+
+    bool expired(const deadline_t &deadline) {
+        return DWT->CYCCNT - deadline.start >= deadline.cycles;
+    }
+}
+
+/**
+ * Flash programming for the persistent storage area at the end of the FLASH.\n
+ * The core stalls on instruction fetch while a page erases (~20ms), DMA keeps running
+ */
+namespace flash {
+    constexpr uint32_t PAGE_SIZE = 1024;
+    constexpr uint32_t STORAGE = 0x0800E000; // Last 8K, excluded from FLASH in the linker script
+    constexpr uint32_t STORAGE_SIZE = 8 * PAGE_SIZE; // Pages 0-3: curve.h, 4: tuner.h, 5-6: audio.h, 7: alarms.h
+
+    void unlock() {
+        if (FLASH->CR & FLASH_CR_LOCK) {
+            FLASH->KEYR = FLASH_KEY1;
+            FLASH->KEYR = FLASH_KEY2;
+        }
+    }
+
+    /**
+     * Waits for the operation to end, clears the flags and locks the FPEC again
+     * @return false on a programming or write protection error
+     */
+    bool finish() {
+        while (FLASH->SR & FLASH_SR_BSY);
+        bool ok = !(FLASH->SR & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR));
+        FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+        FLASH->CR = FLASH_CR_LOCK;
+        return ok;
+    }
+
+    bool erase_page(uint32_t address) {
+        unlock();
+        FLASH->CR = FLASH_CR_PER;
+        FLASH->AR = address;
+        FLASH->CR = FLASH_CR_PER | FLASH_CR_STRT;
+        return finish();
+    }
+
+    /**
+     * Programs halfwords, the target has to be erased
+     * @param address Halfword aligned
+     * @param length Number of bytes, an odd last byte is padded with 0xff
+     */
+    bool program(uint32_t address, const uint8_t *data, uint32_t length) {
+        unlock();
+        FLASH->CR = FLASH_CR_PG;
+        for (uint32_t i = 0; i < length; i += 2) {
+            uint16_t half = static_cast<uint16_t>(data[i] | (i + 1 < length ? data[i + 1] : 0xff) << 8);
+            *reinterpret_cast<volatile uint16_t *>(address + i) = half;
+            while (FLASH->SR & FLASH_SR_BSY);
+            if (FLASH->SR & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) {
+                break;
+            }
+        }
+        return finish();
     }
 }
 
@@ -0,0 +1,192 @@
+/**
+ * @file power.h
+ * Idle manager, enters STOP mode when no DMA transfer is pending and no driver holds a lock.\n
+ * Wakeup sources are the EXTI lines (nRF IRQ on A3, buttons on A11/A12, RTC alarm on line 17),
+ * the clocks are restored with a fast path.
+ * The timebase and with it the timer wheel pause in STOP, so with timers pending STOP is only entered if the
+ * next one is at least TIMED_STOP_MIN_MS away: the RTC alarm wakes the MCU in the second before it, and the time
+ * the RTC saw passing is added to the timebase. The rest of the wait is plain sleep.\n
+ * Each wakeup is timed in two parts: the STOP exit (regulator and HSI startup) from the RTC alarm edge
+ * to the WFI return, only measurable for RTC wakeups and at the RTC resolution of ~31us, and the clock restore
+ * plus interrupt entry from the WFI return to the handler of the wakeup source in core cycles.
+ * The residency of every STOP is measured on the RTC, with the total time since init() it gives the average
+ * current as (stop_ms * I_stop + (total_ms - stop_ms) * I_run) / total_ms
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_POWER_H
+#define ALARM_CLOCK_LAMP_POWER_H
+
+#include "peripherals.h"
+#include "events.h"
+#include "timers.h"
+#include "timebase.h"
+#include "rtc.h"
+
+namespace power {
+    struct stats_t {
+        uint32_t sleeps; // Plain wfi in RUN mode
+        uint32_t stops;
+        uint32_t wake_cycles_last; // Core cycles from the WFI return to the wakeup handler, mostly at 8MHz HSI
+        uint32_t wake_cycles_max;
+        uint16_t exit_us_last; // From the RTC alarm edge to the WFI return
+        uint16_t exit_us_max;
+        uint32_t timed_stops; // Entered with timers pending, woken by the RTC or any other source
+        uint64_t stop_q16; // Residency of all stops in 1/65536s, measured on the RTC
+    };
+
+    constexpr uint32_t TIMED_STOP_MIN_MS = 2000; // The RTC alarm has a resolution of one second
+
+    uint8_t stop_locks; // Drivers that need their clocks while idle, e.g. running PWM
+    stats_t stats;
+    uint64_t init_q16;
+    uint64_t stop_start_q16;
+    uint32_t wake_cycles; // Cycle count at the WFI return of the last STOP
+    volatile bool wake_unclaimed; // No wakeup handler ran since
+    bool wake_unaccounted; // Residency still to add, needs the RTC resynced
+    bool woke_on_rtc;
+
+    /**
+     * Prevents STOP mode until unlock() is called, calls nest
+     */
+    void lock() {
+        stop_locks++;
+    }
+
+    void unlock() {
+        if (stop_locks) stop_locks--;
+    }
+
+    /**
+     * Returns whether any DMA1 channel is still transferring, STOP would freeze it
+     */
+    bool dma_active() {
+        DMA_Channel_TypeDef *const channels[] = {DMA1_Channel1, DMA1_Channel2, DMA1_Channel3, DMA1_Channel4,
+                                                 DMA1_Channel5, DMA1_Channel6, DMA1_Channel7};
+        for (DMA_Channel_TypeDef *ch : channels) {
+            if ((ch->CCR & DMA_CCR_EN) && (ch->CNDTR || (ch->CCR & DMA_CCR_CIRC))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Enters STOP with the regulator in low power mode and restores the 72MHz clock after wakeup
+     */
+    void stop() {
+        PWR->CR &= ~PWR_CR_PDDS;
+        PWR->CR |= PWR_CR_LPDS | PWR_CR_CWUF;
+        SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+        stop_start_q16 = rtc::now_q16();
+        __WFI();
+        wake_cycles = DWT->CYCCNT;
+        woke_on_rtc = EXTI->PR & rtc::EXTI_LINE;
+        SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+        rcc::restore_hse_pll_after_stop();
+        stats.stops++;
+        wake_unclaimed = true;
+        wake_unaccounted = true;
+    }
+
+    /**
+     * Call first in the EXTI and RTC alarm handlers, the first one after a STOP records the wakeup latency
+     */
+    void woken() {
+        if (wake_unclaimed) {
+            wake_unclaimed = false;
+            uint32_t cycles = DWT->CYCCNT - wake_cycles;
+            stats.wake_cycles_last = cycles;
+            if (cycles > stats.wake_cycles_max) stats.wake_cycles_max = cycles;
+        }
+    }
+
+    /**
+     * Adds the residency of the last STOP and leaves the RTC registers current, from thread mode.
+     * Runs in the idle hook, after the wakeup handler had its chance
+     */
+    void account() {
+        wake_unclaimed = false; // A timed wakeup ends without a handler
+        if (!wake_unaccounted) {
+            return;
+        }
+        wake_unaccounted = false;
+        rtc::sync();
+        uint32_t awake_us = (DWT->CYCCNT - wake_cycles) / dwt::CYCLES_PER_US;
+        uint64_t wake_q16 = rtc::now_q16() - (static_cast<uint64_t>(awake_us) * 4295 >> 16); // 2^16 / 10^6 in Q16
+        if (wake_q16 > stop_start_q16) {
+            stats.stop_q16 += wake_q16 - stop_start_q16;
+        }
+        uint32_t since_edge = static_cast<uint32_t>(wake_q16 & 0xffff);
+        if (woke_on_rtc && since_edge < 0x1000) { // The alarm matches on the second edge, the exit takes far less than 62ms
+            uint16_t exit_us = static_cast<uint16_t>(since_edge * 15625 >> 10);
+            stats.exit_us_last = exit_us;
+            if (exit_us > stats.exit_us_max) stats.exit_us_max = exit_us;
+        }
+    }
+
+    uint32_t stop_ms() {
+        return static_cast<uint32_t>(stats.stop_q16 * 1000 >> 16);
+    }
+
+    /**
+     * Time since init(), wraps after 49 days. Call account() first
+     */
+    uint32_t total_ms() {
+        return static_cast<uint32_t>((rtc::now_q16() - init_q16) * 1000 >> 16);
+    }
+
+    /**
+     * STOP with the RTC alarm as wakeup before the next timer, then advances the timebase by the time slept
+     * @param ahead_ms Time until the next timer
+     */
+    void timed_stop(uint32_t ahead_ms) {
+        rtc::sync(); // Stale after an earlier STOP
+        uint32_t start_us = timebase::now_us32();
+        uint64_t start = rtc::now_q16();
+        uint64_t deadline = start + (static_cast<uint64_t>(ahead_ms) * 4294967 >> 16); // 2^16 / 1000 in Q16, rounded down
+        rtc::set_wakeup(static_cast<uint32_t>(deadline >> 16)); // The counter reaches it no later than the deadline
+        stop();
+        rtc::sync();
+        uint32_t elapsed_us = static_cast<uint32_t>((rtc::now_q16() - start) * 15625 >> 10);
+        uint32_t counted_us = timebase::now_us32() - start_us; // Awake parts before and after
+        rtc::end_wakeup();
+        if (elapsed_us > counted_us) {
+            timebase::skip(elapsed_us - counted_us);
+        }
+        stats.timed_stops++;
+    }
+
+    /**
+     * Idle hook of the event loop, runs with interrupts masked
+     */
+    void idle() {
+        account();
+        if (stop_locks || dma_active() || timebase::short_compare_pending()) {
+            stats.sleeps++;
+            __WFI();
+        } else if (timers::empty()) {
+            stop();
+        } else {
+            int32_t ahead = static_cast<int32_t>(timers::next_work() - timers::now());
+            if (ahead >= static_cast<int32_t>(TIMED_STOP_MIN_MS) && rtc::prescaler && rtc::source == rtc::LSE) { // The LSI is too far off to count on
+                timed_stop(static_cast<uint32_t>(ahead));
+            } else {
+                stats.sleeps++;
+                __WFI();
+            }
+        }
+    }
+
+    /**
+     * Call after rtc::init()
+     */
+    void init() {
+        init_q16 = rtc::now_q16();
+        dwt::enable_cyccnt();
+        events::idle_hook = idle;
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_POWER_H
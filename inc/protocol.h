@@ -0,0 +1,100 @@
+/**
+ * @file protocol.h
+ * Command set of the radio link. The first payload byte is the command, the rest are its arguments.\n
+ * Replies are queued as ACK payload and are delivered with the ACK of the next received packet
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_PROTOCOL_H
+#define ALARM_CLOCK_LAMP_PROTOCOL_H
+
+#include "stm32f1xx.h"
+
+namespace protocol {
+    enum cmd_t : uint8_t {
+        NOP = 0x00, // Does nothing, used to poll for a queued reply
+        LATENCY_SUMMARY = 0x10, // Args: stage; Reply: stage, min, avg, max (u32 cycles), count (u32)
+        LATENCY_HISTOGRAM = 0x11, // Args: stage, first bucket; Reply: stage, first bucket, 14 buckets (u16)
+        LATENCY_RESET = 0x12, // The latency commands reply UNSUPPORTED without LATENCY_STATS
+        POWER_STATS = 0x20, // Reply: sleeps, stops, wake cycles last, max (u32), STOP exit last, max (u16 us),
+                            // timed stops, STOP ms, total ms (u32), see power.h
+        IRQ_LATENCY_BENCH = 0x21, // Args: rounds (u16); Reply: worst latency per irq::level_t (u32 cycles)
+        LIGHT_SET = 0x30, // Args: warm, cold (u16 perceptual level)
+        LIGHT_FADE = 0x31, // Args: warm, cold (u16 perceptual level), duration (u32 ms)
+        LIGHT_CCT_SET = 0x32, // Args: level (u16 perceptual), CCT (u16 kelvin)
+        LIGHT_CCT_FADE = 0x33, // Args: level (u16 perceptual), CCT (u16 kelvin), duration (u32 ms)
+        LIGHT_CALIBRATION = 0x34, // Args: LED batch index into cct::batches
+        CURVE_PLAY = 0x38, // Args: curve id, loop (u8 bool); Reply: ok (u8)
+        CURVE_STOP = 0x39, // Holds the current output
+        CURVE_ERASE = 0x3a, // Args: store slot; Reply: ok (u8)
+        CURVE_WRITE = 0x3b, // Args: store slot, even offset (u16), data; Reply: ok (u8)
+        CURVE_COMMIT = 0x3c, // Args: store slot, length (u16); Reply: ok (u8)
+        PWM_MODE = 0x40, // Args: pwm::mode_t
+        PWM_REPORT = 0x41, // Reply: mode, period (u16), bits (u16 8.8), refills/s (u16), fill cycles last, max (u32), load (u16 permille)
+        EFFECT_START = 0x50, // Args: effects::effect_t, level (u16), CCT (u16 kelvin), time (u16 ms), extra (u8)
+        EFFECT_STOP = 0x51, // Holds the current output
+        EFFECT_STATS = 0x52, // Reply: ticks, tick cycles last, max, budget overruns (u32)
+        TUNER_TUNE = 0x60, // Args: frequency (u32 kHz); Reply: ok (u8)
+        TUNER_SCAN = 0x61, // Reply: ok (u8), the table is ready once TUNER_STATUS reports not busy
+        TUNER_PLAY = 0x62, // Args: station index; Reply: ok (u8)
+        TUNER_STANDBY = 0x63, // Args: standby (u8 bool); Reply: ok (u8)
+        TUNER_STATUS = 0x64, // Reply: busy, frequency (u32 kHz), level, IF count, stereo, high side, I2C result, station count
+        TUNER_STATIONS = 0x65, // Args: first index; Reply: first index, 7 stations (u16 10kHz, level, flags)
+        TUNER_SEEK = 0x66, // Args: time budget (u16 ms); Reply: ok (u8)
+        TUNER_SEEK_STATS = 0x67, // Reply: elapsed (u32 ms), probes (u16), found (u32 kHz, 0 = none)
+        BUZZER_PLAY = 0x70, // Args: melody, start volume, max volume, volume step per repeat, repeat (u8 bool); Reply: ok (u8)
+        BUZZER_STOP = 0x71,
+        AUDIO_PLAY = 0x78, // Args: clip, volume; Reply: ok (u8)
+        AUDIO_STOP = 0x79,
+        AUDIO_ERASE = 0x7a, // Reply: ok (u8)
+        AUDIO_WRITE = 0x7b, // Args: offset (u16), data; Reply: ok (u8)
+        AUDIO_COMMIT = 0x7c, // Args: samples (u16); Reply: ok (u8)
+        AUDIO_STATS = 0x7d, // Reply: blocks, decode cycles last, decode cycles max, late (u32 each)
+        SPEAKER_VOLUME = 0x80, // Args: volume (0-16), fade time (u32 ms)
+        SPEAKER_STATS = 0x81, // Reply: volume, ring rewrites (u32), rewrite cycles last (u32), rewrite cycles max (u32)
+        RTC_SET = 0x90, // Args: seconds since 2000-01-01 (u32)
+        RTC_GET = 0x91, // Reply: seconds (u32), year (u16), month, day, hour, minute, second, weekday, clock source
+        ALARM_SET = 0x98, // Args: slot, minute of day (u16), weekdays, flags, action, action arg; Reply: ok (u8)
+        ALARM_SKIP = 0x99, // Args: slot, skip (u8 bool); Reply: ok (u8)
+        ALARM_HOLIDAY = 0x9a, // Args: day since 2000-01-01 (u16), add (u8 bool); Reply: ok (u8)
+        ALARM_GET = 0x9b, // Args: slot; Reply: slot, minute of day (u16), weekdays, flags, action, action arg, next fire (u32)
+        ALARM_NEXT = 0x9c, // Reply: next fire of all alarms (u32 seconds, 0xffffffff = none)
+        TIME_SYNC = 0xa0 // Args: seq, remote time at the start of the transmission (u32 seconds, u16 1/65536s),
+                         // round trip of seq - 1 (u16 us, 0xffff = none);
+                         // Reply: seq, reception time (u32 seconds, u16 1/65536s), last offset (i32 1/65536s),
+                         // rate correction (i16 ppm/16), drift estimates (u16)
+    };
+
+    constexpr uint8_t UNSUPPORTED = 0xff; // Only reply byte of a command whose feature is not built in
+
+    /**
+     * What an alarm does when it fires, the action arg selects the curve, melody, clip or radio volume
+     */
+    enum alarm_action_t : uint8_t {
+        ALARM_CURVE,
+        ALARM_BUZZER,
+        ALARM_AUDIO,
+        ALARM_RADIO
+    };
+
+    void put_u16(uint8_t *buffer, uint16_t value) {
+        buffer[0] = static_cast<uint8_t>(value);
+        buffer[1] = static_cast<uint8_t>(value >> 8);
+    }
+
+    void put_u32(uint8_t *buffer, uint32_t value) {
+        put_u16(buffer, static_cast<uint16_t>(value));
+        put_u16(buffer + 2, static_cast<uint16_t>(value >> 16));
+    }
+
+    uint16_t get_u16(const uint8_t *buffer) {
+        return static_cast<uint16_t>(buffer[0] | buffer[1] << 8);
+    }
+
+    uint32_t get_u32(const uint8_t *buffer) {
+        return get_u16(buffer) | static_cast<uint32_t>(get_u16(buffer + 2)) << 16;
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_PROTOCOL_H
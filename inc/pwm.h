@@ -0,0 +1,323 @@
+/**
+ * @file pwm.h
+ * TIM1 PWM driver for the warm (CH1, A8) and cold (CH2, A9) LED channels.\n
+ * Duty values can be streamed by DMA: once per PWM period the TIM1_CH3 request (CCR3 = 0, right after the update)
+ * triggers a burst through DMAR into CCR1/CCR2. The ring is refilled in halves from a source callback.
+ * TIM1_UP is not used, its DMA channel 5 belongs to I2C2 RX.\n
+ * Duty values are always 0..DUTY_MAX and scaled to the period of the mode. Whichever engine drives the LEDs
+ * keeps output up to date, so the next one starts its fade from what is lit and never jumps. TIM1 runs at 36MHz (HCLK = SYSCLK / 2),
+ * so the 16 bit mode is at 549Hz. The high frequency modes trade PWM bits for a flicker free rate, the dithering
+ * in brightness.h recovers up to 8 bits, as many as keep every pattern at DITHER_MIN_HZ or faster: the lowest
+ * component of a pattern is the PWM rate over 2^bits, at 549Hz a full 8 bits would blink at 2Hz.
+ * Per mode (ripple is one LSB of the period, refills are ring half refills from the DMA interrupt):
+ *
+ * | Mode     | PWM    | Period | PWM bits | With dither | Ripple | Dither freq | Refills/s |
+ * |----------|--------|--------|----------|-------------|--------|-------------|-----------|
+ * | STANDARD | 549Hz  | 65536  | 16.0     | 19.0        | 15ppm  | 69Hz        | 17        |
+ * | HF_20K   | 20kHz  | 1800   | 10.8     | 18.8        | 556ppm | 78Hz        | 625       |
+ * | HF_25K   | 25kHz  | 1440   | 10.5     | 18.5        | 694ppm | 98Hz        | 781       |
+ * | HF_36K   | 36kHz  | 1000   | 10.0     | 18.0        | 0.1%   | 141Hz       | 1125      |
+ *
+ * The CPU load is the fill cycles per refill times the refill rate, see stats and report(), it is
+ * measured since it depends on the active source. The DMA moves 2 halfwords per period in every mode.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_PWM_H
+#define ALARM_CLOCK_LAMP_PWM_H
+
+#include "peripherals.h"
+#include "power.h"
+#include "latency.h"
+#include "irq.h"
+
+namespace pwm {
+    struct frame_t {
+        uint16_t warm;
+        uint16_t cold;
+    };
+
+    /**
+     * Fills the next frames of the ring, called from the DMA interrupt
+     */
+    using source_t = void (*)(frame_t *frames, uint16_t count);
+
+    TIM_TypeDef *const TIM = TIM1;
+    DMA_Channel_TypeDef *const DMA_CH = DMA1_Channel6; // TIM1_CH3 request
+    constexpr uint32_t TIM_CLOCK = 36000000;
+    constexpr uint16_t DUTY_MAX = 0xffff; // Full scale of all duty values, independent of the mode
+    constexpr uint16_t FRAMES = 64; // Ring length, refilled in halves
+
+    enum mode_t : uint8_t {
+        STANDARD,
+        HF_20K,
+        HF_25K,
+        HF_36K,
+        MODE_COUNT
+    };
+
+    struct mode_config_t {
+        uint16_t period; // ARR
+        uint32_t frames_per_ms_q16; // PWM periods per ms in 16.16
+        uint32_t duty_scale_q16; // DUTY_MAX to period
+        uint16_t bits_q8; // PWM resolution without dithering
+        uint8_t dither_bits; // Fractional duty bits the dithering resolves
+    };
+
+    constexpr uint32_t DITHER_MIN_HZ = 60; // Lowest component of a dither pattern, slower ones flicker
+
+    /**
+     * Up to 8 fractional bits, as many as keep the longest pattern, 2^bits periods, at DITHER_MIN_HZ
+     */
+    constexpr uint8_t dither_bits(uint32_t steps) {
+        uint8_t bits = 8;
+        while (bits && TIM_CLOCK / steps >> bits < DITHER_MIN_HZ) {
+            bits--;
+        }
+        return bits;
+    }
+
+    /**
+     * @param steps Timer clocks per PWM period
+     */
+    constexpr mode_config_t make_mode(uint32_t steps) {
+        double bits = 0, x = steps;
+        while (x >= 2.0) {
+            x /= 2.0;
+            bits += 1.0;
+        }
+        for (double bit = 0.5; bit > 1.0 / 512; bit /= 2.0) { // Fractional part by repeated squaring
+            x *= x;
+            if (x >= 2.0) {
+                x /= 2.0;
+                bits += bit;
+            }
+        }
+        return {static_cast<uint16_t>(steps - 1),
+                static_cast<uint32_t>((static_cast<uint64_t>(TIM_CLOCK) << 16) / steps / 1000),
+                static_cast<uint32_t>((static_cast<uint64_t>(steps - 1) << 16) / DUTY_MAX),
+                static_cast<uint16_t>(bits * 256.0 + 0.5), dither_bits(steps)};
+    }
+
+    constexpr mode_config_t modes[MODE_COUNT] = {
+        make_mode(65536), make_mode(TIM_CLOCK / 20000), make_mode(TIM_CLOCK / 25000), make_mode(TIM_CLOCK / 36000)
+    };
+    static_assert(modes[STANDARD].period == DUTY_MAX && modes[STANDARD].duty_scale_q16 == 0x10000);
+    static_assert(modes[STANDARD].frames_per_ms_q16 == 36000);
+    static_assert(modes[STANDARD].dither_bits == 3 && modes[HF_20K].dither_bits == 8);
+
+    /**
+     * Cycles spent in the source per ring half refill
+     */
+    struct stats_t {
+        uint32_t refills;
+        uint32_t cycles_last;
+        uint32_t cycles_max;
+    };
+
+    /**
+     * Current output in duty 16.8, before scaling and dithering. Written by set() and by every stream source,
+     * which is up to one ring ahead of the LEDs
+     */
+    struct output_t {
+        uint32_t warm_q8;
+        uint32_t cold_q8;
+    };
+
+    frame_t ring[FRAMES];
+    output_t output;
+    source_t source;
+    bool stop_locked;
+    const mode_config_t *mode = &modes[STANDARD];
+    stats_t stats;
+
+    /**
+     * Scales a duty value to the period of the current mode
+     */
+    uint16_t scale(uint16_t duty) {
+        return static_cast<uint16_t>(duty * mode->duty_scale_q16 >> 16);
+    }
+
+    /**
+     * Number of frames in the given time at the current rate, rounds down to at least 1
+     */
+    uint32_t frames_in(uint32_t duration_ms) {
+        uint32_t frames = static_cast<uint32_t>(static_cast<uint64_t>(duration_ms) * mode->frames_per_ms_q16 >> 16);
+        return frames ? frames : 1;
+    }
+
+    /**
+     * Holds a stop lock while any LED is lit or a stream runs, TIM1 halts in STOP mode
+     */
+    void update_stop_lock(bool needed) {
+        if (needed && !stop_locked) {
+            power::lock();
+        } else if (!needed && stop_locked) {
+            power::unlock();
+        }
+        stop_locked = needed;
+    }
+
+    void init() {
+        tim::set_prescaler(TIM, 0);
+        tim::set_period(TIM, mode->period);
+        TIM->CCMR1 = TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE // PWM mode 1, preloaded
+                   | TIM_CCMR1_OC2M_2 | TIM_CCMR1_OC2M_1 | TIM_CCMR1_OC2PE;
+        TIM->CCR1 = 0;
+        TIM->CCR2 = 0;
+        TIM->CCR3 = 0; // Frozen, only used as DMA request at the start of each period
+        TIM->CCER = TIM_CCER_CC1E | TIM_CCER_CC2E;
+        TIM->BDTR = TIM_BDTR_MOE;
+        TIM->DCR = (((uint32_t) &TIM->CCR1 - (uint32_t) &TIM->CR1) / 4) << TIM_DCR_DBA_Pos | 1 << TIM_DCR_DBL_Pos; // 2 transfers
+        TIM->CR1 |= TIM_CR1_ARPE;
+        tim::generate_update(TIM);
+        DMA_CH->CPAR = (uint32_t) &TIM->DMAR;
+        DMA_CH->CMAR = (uint32_t) ring;
+        DMA_CH->CCR = DMA_CCR_MSIZE_0 | DMA_CCR_PSIZE_0 | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_DIR
+                    | DMA_CCR_HTIE | DMA_CCR_TCIE;
+        tim::enable(TIM);
+        dwt::enable_cyccnt();
+        NVIC_EnableIRQ(DMA1_Channel6_IRQn);
+    }
+
+    void stop_stream() {
+        TIM->DIER &= ~TIM_DIER_CC3DE;
+        DMA_CH->CCR &= ~DMA_CCR_EN;
+        source = nullptr;
+    }
+
+    /**
+     * Sets a constant output, stops a running stream
+     */
+    void set(uint16_t warm, uint16_t cold) {
+        stop_stream();
+        TIM->CCR1 = scale(warm);
+        TIM->CCR2 = scale(cold);
+        output = {static_cast<uint32_t>(warm) << 8, static_cast<uint32_t>(cold) << 8};
+        latency::stamp(latency::PWM_UPDATED);
+        update_stop_lock(warm || cold);
+    }
+
+    /**
+     * Streams frames from the source by DMA, one frame per PWM period
+     */
+    void stream(source_t src) {
+        stop_stream();
+        source = src;
+        source(ring, FRAMES);
+        DMA1->IFCR = DMA_IFCR_CGIF6;
+        DMA_CH->CNDTR = FRAMES * 2;
+        DMA_CH->CCR |= DMA_CCR_EN;
+        TIM->DIER |= TIM_DIER_CC3DE;
+        latency::stamp(latency::PWM_UPDATED);
+        update_stop_lock(true);
+    }
+
+    /**
+     * Call from DMA1_Channel6_IRQHandler, refills the half the DMA just left
+     */
+    void irq() {
+        uint32_t isr = DMA1->ISR;
+        DMA1->IFCR = DMA_IFCR_CGIF6;
+        if (!source) {
+            return;
+        }
+        uint32_t start = DWT->CYCCNT;
+        if (isr & DMA_ISR_HTIF6) {
+            source(ring, FRAMES / 2);
+        }
+        if (isr & DMA_ISR_TCIF6) {
+            source(ring + FRAMES / 2, FRAMES / 2);
+        }
+        stats.cycles_last = DWT->CYCCNT - start;
+        if (stats.cycles_last > stats.cycles_max) stats.cycles_max = stats.cycles_last;
+        stats.refills++;
+    }
+
+    /**
+     * Switches the PWM frequency, a running stream continues at the new rate.
+     * Fades keep their frame count, so one in progress changes its duration
+     */
+    void set_mode(mode_t new_mode) {
+        if (new_mode >= MODE_COUNT) {
+            return;
+        }
+        source_t running = source;
+        stop_stream();
+        mode = &modes[new_mode];
+        tim::set_period(TIM, mode->period);
+        TIM->CCR1 = scale(static_cast<uint16_t>(output.warm_q8 >> 8));
+        TIM->CCR2 = scale(static_cast<uint16_t>(output.cold_q8 >> 8));
+        stats = {};
+        if (running) {
+            stream(running);
+        }
+    }
+
+    /**
+     * Ring half refills per second at the current rate
+     */
+    uint32_t refills_per_s() {
+        return mode->frames_per_ms_q16 * 1000 / (FRAMES / 2) >> 16;
+    }
+
+    /**
+     * CPU load of the refills in permille, from the worst refill seen
+     */
+    uint32_t load_permille() {
+        return stats.cycles_max * refills_per_s() / (TIM_CLOCK / 1000);
+    }
+
+    /**
+     * Linear fade source with 16.16 fixed point accumulators, no division per frame
+     */
+    namespace ramp {
+        uint32_t warm, cold; // 16.16
+        uint32_t warm_step, cold_step; // Two's complement, wraps correctly
+        uint16_t warm_target, cold_target;
+        uint32_t remaining;
+
+        uint32_t step(uint16_t from, uint16_t to, uint32_t frames) {
+            uint32_t magnitude = (to > from ? to - from : from - to) * 65536UL / frames;
+            return to > from ? magnitude : 0 - magnitude;
+        }
+
+        void fill(frame_t *frames, uint16_t count) {
+            for (uint16_t i = 0; i < count; i++) {
+                if (remaining) {
+                    remaining--;
+                    warm += warm_step;
+                    cold += cold_step;
+                    if (!remaining) {
+                        warm = static_cast<uint32_t>(warm_target) << 16;
+                        cold = static_cast<uint32_t>(cold_target) << 16;
+                    }
+                }
+                frames[i].warm = scale(static_cast<uint16_t>(warm >> 16));
+                frames[i].cold = scale(static_cast<uint16_t>(cold >> 16));
+            }
+            output = {warm >> 8, cold >> 8};
+        }
+
+        /**
+         * Fades from the current output to the target, e.g. a 30 minute sunrise
+         */
+        void start(uint16_t to_warm, uint16_t to_cold, uint32_t duration_ms) {
+            uint32_t frames = frames_in(duration_ms);
+            irq::critical_section cs; // The running source writes output in the DMA interrupt
+            uint16_t from_warm = static_cast<uint16_t>(output.warm_q8 >> 8);
+            uint16_t from_cold = static_cast<uint16_t>(output.cold_q8 >> 8);
+            warm = static_cast<uint32_t>(from_warm) << 16;
+            cold = static_cast<uint32_t>(from_cold) << 16;
+            warm_step = step(from_warm, to_warm, frames);
+            cold_step = step(from_cold, to_cold, frames);
+            warm_target = to_warm;
+            cold_target = to_cold;
+            remaining = frames;
+            stream(fill);
+        }
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_PWM_H
@@ -0,0 +1,333 @@
+/**
+ * @file rtc.h
+ * Real time clock on the backup domain: a 32 bit second counter clocked by the 32.768kHz LSE.\n
+ * Time is kept as seconds since 2000-01-01 00:00:00 local time, which lasts until 2136.
+ * The calendar conversion is the days/civil algorithm of H. Hinnant: no loops over years or months,
+ * only divisions by constants, which the compiler turns into multiplications.
+ * The backup domain keeps counting through resets (and on VBAT), BKP->DR1 marks it as set up,
+ * so a reset neither stops nor resets the clock. BKP->DR2 holds the rate correction, the others are free.
+ *
+ * The rate correction combines the calibration register, which can only slow the clock in steps of 2^-20,
+ * with a prescaler one tick short (+30.5ppm) for negative corrections, giving -30..+121ppm.
+ *
+ * The alarm fires on EXTI line 17, which also wakes the MCU from STOP mode, the callback runs in thread mode.
+ * power.h borrows the alarm register as a plain wakeup for far timers, it restores the alarm afterwards.
+ * If the LSE does not start the clock falls back to the LSI, which is off by up to +-50%.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_RTC_H
+#define ALARM_CLOCK_LAMP_RTC_H
+
+#include "peripherals.h"
+#include "events.h"
+#include "irq.h"
+
+namespace rtc {
+    using callback_t = void (*)();
+
+    constexpr uint16_t MAGIC = 0xc10c;
+    constexpr uint32_t LSE_TIMEOUT_US = 3000000; // Start up is specified with up to 2s
+    constexpr uint32_t EXTI_LINE = 1UL << 17;
+    constexpr uint8_t EPOCH_WEEKDAY = 5; // 2000-01-01 was a Saturday, 0 = Monday
+
+    /**
+     * Backup register indices
+     */
+    enum backup_t : uint8_t {
+        BACKUP_MAGIC,
+        BACKUP_CORRECTION, // Slowdown in ppm/16, signed
+        BACKUP_FREE // First one free for the drivers, up to 9
+    };
+
+    constexpr int32_t CORRECTION_MIN_Q4 = -30 * 16;
+    constexpr int32_t CORRECTION_MAX_Q4 = 121 * 16;
+
+    enum source_t : uint8_t {
+        LSE,
+        LSI
+    };
+
+    struct datetime_t {
+        uint16_t year;
+        uint8_t month; // 1..12
+        uint8_t day; // 1..31
+        uint8_t hour;
+        uint8_t minute;
+        uint8_t second;
+        uint8_t weekday; // 0 = Monday
+    };
+
+    source_t source;
+    uint32_t prescaler; // PRL is write only
+    callback_t alarm_callback;
+    volatile bool armed;
+    uint32_t alarm_at; // While armed
+
+    /**
+     * Days since 2000-01-01 of a date from 2000 on
+     */
+    constexpr uint32_t days_from_civil(uint16_t year, uint8_t month, uint8_t day) {
+        uint32_t y = year - (month <= 2);
+        uint32_t era = y / 400;
+        uint32_t yoe = y - era * 400;
+        uint32_t doy = (153 * (month > 2 ? month - 3U : month + 9U) + 2) / 5 + day - 1;
+        uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 730425; // Day 0 is 0000-03-01
+    }
+
+    constexpr uint32_t to_seconds(const datetime_t &dt) {
+        return days_from_civil(dt.year, dt.month, dt.day) * 86400 + dt.hour * 3600UL + dt.minute * 60UL + dt.second;
+    }
+
+    constexpr datetime_t to_datetime(uint32_t seconds) {
+        uint32_t days = seconds / 86400;
+        uint32_t rest = seconds - days * 86400;
+        datetime_t dt{};
+        dt.hour = static_cast<uint8_t>(rest / 3600);
+        rest -= dt.hour * 3600UL;
+        dt.minute = static_cast<uint8_t>(rest / 60);
+        dt.second = static_cast<uint8_t>(rest - dt.minute * 60UL);
+        dt.weekday = static_cast<uint8_t>((days + EPOCH_WEEKDAY) % 7);
+        uint32_t z = days + 730425;
+        uint32_t era = z / 146097;
+        uint32_t doe = z - era * 146097;
+        uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        uint32_t mp = (5 * doy + 2) / 153;
+        dt.day = static_cast<uint8_t>(doy - (153 * mp + 2) / 5 + 1);
+        dt.month = static_cast<uint8_t>(mp < 10 ? mp + 3 : mp - 9);
+        dt.year = static_cast<uint16_t>(yoe + era * 400 + (dt.month <= 2));
+        return dt;
+    }
+
+    static_assert(days_from_civil(2000, 1, 1) == 0);
+    static_assert(days_from_civil(2024, 2, 29) == 8825);
+    static_assert(to_datetime(to_seconds({2024, 2, 29, 23, 59, 58, 0})).day == 29);
+    static_assert(to_datetime(to_seconds({2100, 3, 1, 0, 0, 0, 0})).month == 3);
+    static_assert(to_datetime(8825 * 86400UL).weekday == 3); // Thursday
+
+    /**
+     * Backup registers DR1..DR10, see backup_t
+     */
+    uint16_t backup_read(uint8_t index) {
+        return static_cast<uint16_t>((&BKP->DR1)[index]);
+    }
+
+    void backup_write(uint8_t index, uint16_t value) {
+        (&BKP->DR1)[index] = value;
+    }
+
+    void enter_config() {
+        while (!(RTC->CRL & RTC_CRL_RTOFF));
+        RTC->CRL |= RTC_CRL_CNF;
+    }
+
+    void exit_config() {
+        RTC->CRL &= ~RTC_CRL_CNF;
+        while (!(RTC->CRL & RTC_CRL_RTOFF));
+    }
+
+    /**
+     * Waits for the registers to resync with the RTC clock, needed after a reset or STOP mode, up to ~60us
+     */
+    void sync() {
+        RTC->CRL &= ~RTC_CRL_RSF;
+        while (!(RTC->CRL & RTC_CRL_RSF));
+    }
+
+    /**
+     * Current time in seconds since the epoch, safe from any context. Stale right after STOP until sync()
+     */
+    uint32_t now() {
+        uint32_t high, low;
+        do {
+            high = RTC->CNTH;
+            low = RTC->CNTL;
+        } while (high != RTC->CNTH);
+        return high << 16 | low;
+    }
+
+    /**
+     * Current time in 1/65536s, see now()
+     */
+    uint64_t now_q16() {
+        uint32_t seconds, divider;
+        do {
+            seconds = now();
+            divider = (RTC->DIVH & RTC_DIVH_RTC_DIV) << 16 | RTC->DIVL;
+        } while (seconds != now());
+        uint32_t elapsed = prescaler - (divider > prescaler ? prescaler : divider); // DIV counts down
+        return static_cast<uint64_t>(seconds) << 16 | (elapsed << 16) / (prescaler + 1);
+    }
+
+    void set(uint32_t seconds) {
+        enter_config();
+        RTC->CNTH = seconds >> 16;
+        RTC->CNTL = seconds & 0xffff;
+        exit_config();
+    }
+
+    void write_prescaler(uint32_t value) {
+        enter_config();
+        RTC->PRLH = value >> 16;
+        RTC->PRLL = value & 0xffff;
+        exit_config();
+        prescaler = value;
+    }
+
+    int32_t correction_q4() {
+        return static_cast<int16_t>(backup_read(BACKUP_CORRECTION));
+    }
+
+    /**
+     * Sets the rate correction, positive slows the clock down. Only for the LSE, the LSI is too far off anyway
+     * @param ppm_q4 Correction in ppm/16, clamped to CORRECTION_MIN_Q4..CORRECTION_MAX_Q4
+     */
+    void set_correction(int32_t ppm_q4) {
+        if (source != LSE) {
+            return;
+        }
+        if (ppm_q4 < CORRECTION_MIN_Q4) ppm_q4 = CORRECTION_MIN_Q4;
+        if (ppm_q4 > CORRECTION_MAX_Q4) ppm_q4 = CORRECTION_MAX_Q4;
+        int32_t slowdown = ppm_q4;
+        uint32_t value = 32767;
+        if (slowdown < 0) {
+            value = 32766;
+            slowdown += 488; // 1/32768 = 30.52ppm
+        }
+        uint32_t cal = (static_cast<uint32_t>(slowdown) * 68719 + (1 << 19)) >> 20; // 2^20 / 10^6 / 16 in Q16
+        if (cal > BKP_RTCCR_CAL) cal = BKP_RTCCR_CAL;
+        if (value != prescaler) {
+            write_prescaler(value);
+        }
+        MODIFY_REG(BKP->RTCCR, BKP_RTCCR_CAL, cal);
+        backup_write(BACKUP_CORRECTION, static_cast<uint16_t>(ppm_q4));
+    }
+
+    void fire() {
+        bool was_armed;
+        {
+            irq::critical_section cs;
+            was_armed = armed;
+            armed = false;
+        }
+        if (was_armed) {
+            events::post(events::RTC_ALARM);
+        }
+    }
+
+    /**
+     * Calls the alarm callback from the event loop at the given time, right away if it already passed
+     */
+    void program_alarm(uint32_t seconds) {
+        RTC->CRH &= ~RTC_CRH_ALRIE;
+        enter_config();
+        RTC->ALRH = seconds >> 16;
+        RTC->ALRL = seconds & 0xffff;
+        exit_config();
+        RTC->CRL &= ~RTC_CRL_ALRF;
+        RTC->CRH |= RTC_CRH_ALRIE;
+    }
+
+    void set_alarm(uint32_t seconds) {
+        alarm_at = seconds;
+        armed = true;
+        program_alarm(seconds);
+        if (static_cast<int32_t>(now() - seconds) >= 0) {
+            fire(); // The counter may have passed while writing, the flag only sets on equality
+        }
+    }
+
+    /**
+     * Wakes the MCU from STOP mode at the given time without an alarm event, unless the alarm comes first.
+     * Call end_wakeup() after the wakeup, with interrupts still masked
+     */
+    void set_wakeup(uint32_t seconds) {
+        if (armed && static_cast<int32_t>(alarm_at - seconds) <= 0) {
+            return;
+        }
+        program_alarm(seconds);
+    }
+
+    /**
+     * Drops a pending wakeup and puts the alarm back, an alarm that passed meanwhile fires. Needs sync() first
+     */
+    void end_wakeup() {
+        EXTI->PR = EXTI_LINE;
+        RTC->CRL &= ~RTC_CRL_ALRF;
+        NVIC_ClearPendingIRQ(RTC_Alarm_IRQn);
+        if (armed) {
+            set_alarm(alarm_at);
+        } else {
+            RTC->CRH &= ~RTC_CRH_ALRIE;
+        }
+    }
+
+    void cancel_alarm() {
+        RTC->CRH &= ~RTC_CRH_ALRIE;
+        armed = false;
+    }
+
+    /**
+     * Call from RTC_Alarm_IRQHandler
+     */
+    void irq() {
+        EXTI->PR = EXTI_LINE;
+        RTC->CRL &= ~RTC_CRL_ALRF;
+        fire();
+    }
+
+    void on_alarm(uint32_t) {
+        sync(); // After a wakeup from STOP the registers are stale
+        if (alarm_callback) {
+            alarm_callback();
+        }
+    }
+
+    /**
+     * Starts the clock on the first power up, only resyncs to the running one after a reset.
+     * Blocks up to LSE_TIMEOUT_US on the first power up
+     */
+    void init() {
+        RCC->APB1ENR |= RCC_APB1ENR_PWREN | RCC_APB1ENR_BKPEN;
+        PWR->CR |= PWR_CR_DBP; // Stays set, the RTC and backup registers are written at runtime
+        if (backup_read(BACKUP_MAGIC) == MAGIC && (RCC->BDCR & RCC_BDCR_RTCEN)) {
+            source = (RCC->BDCR & RCC_BDCR_RTCSEL) == RCC_BDCR_RTCSEL_LSE ? LSE : LSI;
+            prescaler = source == LSI ? 39999 : correction_q4() < 0 ? 32766 : 32767;
+            if (source == LSI) {
+                RCC->CSR |= RCC_CSR_LSION; // Not in the backup domain, a reset turned it off
+                while (!(RCC->CSR & RCC_CSR_LSIRDY));
+            }
+            sync();
+        } else {
+            RCC->BDCR |= RCC_BDCR_BDRST;
+            RCC->BDCR &= ~RCC_BDCR_BDRST;
+            RCC->BDCR |= RCC_BDCR_LSEON;
+            dwt::enable_cyccnt();
+            dwt::deadline_t deadline = dwt::deadline_us(LSE_TIMEOUT_US);
+            while (!(RCC->BDCR & RCC_BDCR_LSERDY) && !dwt::expired(deadline));
+            uint32_t value = 32767;
+            source = LSE;
+            if (!(RCC->BDCR & RCC_BDCR_LSERDY)) {
+                RCC->BDCR &= ~RCC_BDCR_LSEON;
+                RCC->CSR |= RCC_CSR_LSION;
+                while (!(RCC->CSR & RCC_CSR_LSIRDY));
+                value = 39999;
+                source = LSI;
+            }
+            RCC->BDCR |= (source == LSE ? RCC_BDCR_RTCSEL_LSE : RCC_BDCR_RTCSEL_LSI) | RCC_BDCR_RTCEN;
+            sync();
+            write_prescaler(value);
+            set(0);
+            backup_write(BACKUP_MAGIC, MAGIC);
+        }
+        EXTI->IMR |= EXTI_LINE;
+        EXTI->RTSR |= EXTI_LINE;
+        events::subscribe(events::RTC_ALARM, on_alarm);
+        NVIC_EnableIRQ(RTC_Alarm_IRQn);
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_RTC_H
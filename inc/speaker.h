@@ -0,0 +1,206 @@
+/**
+ * @file speaker.h
+ * Soft mute and volume of the radio speaker by modulating its ground switch on B12.\n
+ * B12 has no timer output, so DMA1 channel 1 writes a 64 word sigma-delta pattern into GPIOB->BSRR,
+ * paced by the TIM2_CH3 request (CCR3 = 0) at 250kHz. The pulse density sets the volume, the sigma-delta
+ * spreads the pulses, so the chopping stays above ~20kHz down to the lowest step (5/64, -22.5dB).
+ * Volume steps are 1.5dB apart. Fades step every FRAME_MS from the timer wheel, each frame rewrites the ring,
+ * there are no DMA interrupts. While modulating the DMA takes a few percent of the bus bandwidth.
+ *
+ * Fully muted and fully on are static: the DMA only runs in between. Going static, the ring is first filled
+ * with the final level and the DMA stopped one frame later, which is many ring passes, so the pin already holds
+ * that level and nothing changes on it. Going back, the ring starts at the first step next to the static level.
+ * TIM2 is shared with buzzer.h and audio.h, while they play the speaker only has the two static levels.
+ * A fade holds at the static level it was left at and continues from there once TIM2 is free, only set() to
+ * muted or fully on goes through.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_SPEAKER_H
+#define ALARM_CLOCK_LAMP_SPEAKER_H
+
+#include "peripherals.h"
+#include "audio.h"
+#include "timers.h"
+
+namespace speaker {
+    TIM_TypeDef *const TIM = TIM2;
+    DMA_Channel_TypeDef *const DMA_CH = DMA1_Channel1; // TIM2_CH3 request
+    GPIO_TypeDef *const GPIO = GPIOB;
+    constexpr uint8_t PIN = 12; // High connects the speaker ground
+    constexpr uint16_t PERIOD = 144; // 250kHz
+    constexpr uint8_t SLOTS = 64;
+    constexpr uint8_t FRAME_MS = 10;
+    constexpr uint8_t VOLUME_MAX = 16;
+
+    constexpr uint8_t density[VOLUME_MAX + 1] = {0, 5, 6, 7, 8, 10, 11, 14, 16, 19, 23, 27, 32, 38, 45, 54, 64};
+
+    /**
+     * Core cycles per ring rewrite
+     */
+    struct stats_t {
+        uint32_t frames;
+        uint32_t cycles_last;
+        uint32_t cycles_max;
+    };
+
+    uint32_t ring[SLOTS];
+    bool modulating;
+    uint8_t current; // Density written last
+    uint32_t volume_q8, target_q8; // Volume steps in 24.8 fixed point
+    uint32_t step_q8;
+    timers::timer_t timer;
+    stats_t stats;
+
+    bool timer_shared() {
+        return buzzer::playing() || audio::playing();
+    }
+
+    /**
+     * Density of a fractional volume, interpolated between the steps
+     */
+    uint8_t density_of(uint32_t q8) {
+        uint32_t index = q8 >> 8;
+        if (index >= VOLUME_MAX) {
+            return SLOTS;
+        }
+        uint32_t low = density[index], high = density[index + 1];
+        return static_cast<uint8_t>(low + ((high - low) * (q8 & 0xff) >> 8));
+    }
+
+    void fill(uint8_t on) {
+        uint32_t start = DWT->CYCCNT;
+        uint8_t acc = 0;
+        for (uint32_t &word : ring) {
+            acc = static_cast<uint8_t>(acc + on);
+            if (acc >= SLOTS) {
+                acc = static_cast<uint8_t>(acc - SLOTS);
+                word = 1UL << PIN;
+            } else {
+                word = 1UL << (PIN + 16);
+            }
+        }
+        current = on;
+        stats.cycles_last = DWT->CYCCNT - start;
+        if (stats.cycles_last > stats.cycles_max) stats.cycles_max = stats.cycles_last;
+        stats.frames++;
+    }
+
+    void start_modulation() {
+        tim::set_prescaler(TIM, 0);
+        tim::set_period(TIM, static_cast<uint16_t>(PERIOD - 1));
+        TIM->CCR3 = 0; // Frozen, only used as DMA request at the start of each period
+        tim::generate_update(TIM);
+        DMA_CH->CNDTR = SLOTS;
+        DMA_CH->CCR |= DMA_CCR_EN;
+        TIM->DIER |= TIM_DIER_CC3DE;
+        tim::enable(TIM);
+        modulating = true;
+    }
+
+    /**
+     * The pin holds the last level written by the DMA, which has to be a static one
+     */
+    void stop_modulation() {
+        TIM->DIER &= ~TIM_DIER_CC3DE;
+        DMA_CH->CCR &= ~DMA_CCR_EN;
+        tim::disable(TIM);
+        tim::set_prescaler(TIM, buzzer::PRESCALER);
+        tim::generate_update(TIM);
+        modulating = false;
+        if (current) {
+            gpio::set(GPIO, PIN);
+        } else {
+            gpio::reset(GPIO, PIN);
+        }
+    }
+
+    bool is_static(uint32_t q8) {
+        uint8_t on = density_of(q8);
+        return on == 0 || on == SLOTS;
+    }
+
+    /**
+     * Timer callback, one fade step. Waits while TIM2 is taken, unless the step lands on a static target
+     */
+    void frame(uint32_t) {
+        uint32_t distance = target_q8 > volume_q8 ? target_q8 - volume_q8 : volume_q8 - target_q8;
+        if (timer_shared() && (step_q8 < distance || !is_static(target_q8))) {
+            return; // Halfway would snap to muted or fully on
+        }
+        if (volume_q8 < target_q8) {
+            volume_q8 = target_q8 - volume_q8 > step_q8 ? volume_q8 + step_q8 : target_q8;
+        } else {
+            volume_q8 = volume_q8 - target_q8 > step_q8 ? volume_q8 - step_q8 : target_q8;
+        }
+        uint8_t on = density_of(volume_q8);
+        if (on == 0 || on == SLOTS) {
+            if (modulating && current != on) {
+                fill(on); // Stopped next frame, once the pattern went through
+                return;
+            }
+            if (modulating) {
+                stop_modulation();
+            } else if (current != on) {
+                current = on;
+                if (on) gpio::set(GPIO, PIN); else gpio::reset(GPIO, PIN);
+            }
+        } else {
+            if (on != current) {
+                fill(on);
+            }
+            if (!modulating) {
+                start_modulation();
+            }
+        }
+        if (volume_q8 == target_q8) {
+            timers::cancel(timer);
+        }
+    }
+
+    /**
+     * Fades to a volume, 0 is muted and VOLUME_MAX fully on
+     */
+    void fade(uint8_t volume, uint32_t duration_ms) {
+        if (volume > VOLUME_MAX) volume = VOLUME_MAX;
+        target_q8 = static_cast<uint32_t>(volume) << 8;
+        uint32_t frames = duration_ms / FRAME_MS;
+        uint32_t distance = target_q8 > volume_q8 ? target_q8 - volume_q8 : volume_q8 - target_q8;
+        step_q8 = frames ? (distance + frames - 1) / frames : distance;
+        if (!step_q8) step_q8 = 1;
+        timers::start(timer, FRAME_MS, frame, 0, FRAME_MS);
+    }
+
+    void set(uint8_t volume) {
+        fade(volume, 0);
+    }
+
+    uint8_t volume() {
+        return static_cast<uint8_t>(volume_q8 >> 8);
+    }
+
+    /**
+     * Snaps to the nearest static level and frees TIM2, call before the buzzer or audio take it.
+     * A running fade continues from that level afterwards
+     */
+    void release() {
+        if (!modulating) {
+            return;
+        }
+        current = volume_q8 >= VOLUME_MAX << 7 ? SLOTS : 0;
+        volume_q8 = current ? VOLUME_MAX << 8 : 0;
+        stop_modulation();
+    }
+
+    void init() {
+        gpio::reset(GPIO, PIN);
+        gpio::config(GPIO, PIN, gpio::OUT_PUSHPULL, gpio::SPEED_2MHZ);
+        DMA_CH->CPAR = (uint32_t) &GPIO->BSRR;
+        DMA_CH->CMAR = (uint32_t) ring;
+        DMA_CH->CCR = DMA_CCR_MSIZE_1 | DMA_CCR_PSIZE_1 | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_DIR;
+        dwt::enable_cyccnt();
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_SPEAKER_H
@@ -14,8 +14,10 @@ namespace system {
      */
     void enable_all_periphs() {
         RCC->AHBENR |= RCC_AHBENR_DMA1EN;
-        RCC->APB1ENR |= RCC_APB1ENR_I2C2EN | RCC_APB1ENR_TIM2EN;
-        RCC->APB2ENR |= RCC_APB2ENR_IOPAEN | RCC_APB2ENR_IOPBEN | RCC_APB2ENR_AFIOEN | RCC_APB2ENR_SPI1EN;
+        RCC->APB1ENR |= RCC_APB1ENR_I2C2EN | RCC_APB1ENR_TIM2EN | RCC_APB1ENR_TIM3EN | RCC_APB1ENR_TIM4EN
+                        | RCC_APB1ENR_PWREN;
+        RCC->APB2ENR |= RCC_APB2ENR_IOPAEN | RCC_APB2ENR_IOPBEN | RCC_APB2ENR_AFIOEN | RCC_APB2ENR_SPI1EN
+                        | RCC_APB2ENR_TIM1EN;
     }
 
     /**
@@ -35,13 +37,12 @@ namespace system {
         gpio::config(GPIOA, 8, gpio::AF_PUSHPULL, gpio::SPEED_50MHZ);
         gpio::config(GPIOA, 9, gpio::AF_PUSHPULL, gpio::SPEED_50MHZ);
         gpio::config(GPIOA, 11, gpio::IN_PUSHPULL);
+        gpio::set(GPIOA, 11); // Button pull ups, before exti_lines::config() unmasks the falling edges
         gpio::config(GPIOA, 12, gpio::IN_PUSHPULL);
+        gpio::set(GPIOA, 12);
         gpio::config(GPIOA, 15, gpio::OUT_PUSHPULL);
         gpio::config(GPIOB, 10, gpio::AF_OD, gpio::SPEED_50MHZ);
         gpio::config(GPIOB, 11, gpio::AF_OD, gpio::SPEED_50MHZ);
-        gpio::exti_enable_falling_irq<gpio::BANK_A, 3>();
-        gpio::exti_enable_falling_irq<gpio::BANK_A, 11>();
-        gpio::exti_enable_falling_irq<gpio::BANK_A, 12>();
     }
 
     /**
@@ -0,0 +1,213 @@
+/**
+ * @file timebase.h
+ * Free running 64 bit microsecond timebase from two chained 16 bit timers.\n
+ * TIM3 counts microseconds and triggers TIM4 on overflow, TIM4 overflows extend it in software.
+ * Includes one compare that can lie anywhere in the next 2^31us, owned by the timer wheel,
+ * and a short compare within one LOW period for sub-millisecond waits.
+ * Like all timers it pauses in STOP mode, power.h adds the time it measured on the RTC with skip().
+ * The TIM4 overflow interrupt extends it, so it stays monotonic without any reader keeping up with a wrap.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_TIMEBASE_H
+#define ALARM_CLOCK_LAMP_TIMEBASE_H
+
+#include "peripherals.h"
+
+namespace timebase {
+    using callback_t = void (*)();
+
+    TIM_TypeDef *const LOW = TIM3; // 1MHz, master, TRGO on update
+    TIM_TypeDef *const HIGH = TIM4; // Slave in external clock mode on ITR2 (TIM3)
+
+    volatile uint32_t overflows; // HIGH overflows, one every 2^32us ~ 71.6min
+    uint64_t skew; // Added to the hardware count, time skipped in STOP mode
+    uint32_t compare_target;
+    callback_t compare_callback;
+    uint32_t short_target;
+    callback_t short_callback;
+
+    void init() {
+        tim::set_prescaler(LOW, 35); // 36MHz / 36
+        tim::set_period(LOW, 0xffff);
+        tim::generate_update(LOW);
+        MODIFY_REG(LOW->CR2, TIM_CR2_MMS, TIM_CR2_MMS_1); // TRGO = update
+        tim::set_prescaler(HIGH, 0);
+        tim::set_period(HIGH, 0xffff);
+        MODIFY_REG(HIGH->SMCR, TIM_SMCR_TS | TIM_SMCR_SMS, TIM_SMCR_TS_1 | TIM_SMCR_SMS); // ITR2, external clock mode 1
+        tim::generate_update(HIGH);
+        HIGH->DIER |= TIM_DIER_UIE;
+        tim::enable(HIGH);
+        tim::enable(LOW);
+        NVIC_EnableIRQ(TIM3_IRQn);
+        NVIC_EnableIRQ(TIM4_IRQn);
+    }
+
+    /**
+     * Lower 32 bit of the timebase, safe from any context.\n
+     * Rereads while LOW is 0, the chained increment of HIGH may still be in flight
+     */
+    uint32_t now_us32() {
+        uint32_t hi, lo;
+        do {
+            hi = HIGH->CNT;
+            lo = LOW->CNT;
+        } while (hi != HIGH->CNT || lo == 0);
+        return (hi << 16 | lo) + static_cast<uint32_t>(skew);
+    }
+
+    /**
+     * Full 64 bit timebase, safe from any context.\n
+     * An overflow whose interrupt has not run yet is accounted for with the pending flag
+     */
+    uint64_t now_us() {
+        uint32_t ov, hi, lo, pending;
+        do {
+            ov = overflows;
+            hi = HIGH->CNT;
+            lo = LOW->CNT;
+            pending = HIGH->SR & TIM_SR_UIF;
+        } while (hi != HIGH->CNT || lo == 0 || ov != overflows);
+        if (pending && hi < 0x8000) {
+            ov++;
+        }
+        return (static_cast<uint64_t>(ov) << 32 | hi << 16 | lo) + skew;
+    }
+
+    /**
+     * Busy waits at least the given time
+     */
+    void delay_us(uint32_t us) {
+        uint32_t start = now_us32();
+        while (now_us32() - start < us);
+    }
+
+    void delay_ms(uint32_t ms) {
+        delay_us(ms * 1000);
+    }
+
+    /**
+     * Uses the LOW compare if the target is within one LOW period, otherwise the HIGH compare
+     * first wakes up in the right 65.536ms block
+     */
+    void arm_compare() {
+        uint32_t now = now_us32();
+        if (static_cast<int32_t>(compare_target - now) <= 0) {
+            compare_callback();
+            return;
+        }
+        uint32_t hardware = compare_target - static_cast<uint32_t>(skew);
+        if (compare_target - now < 0x10000) {
+            LOW->CCR1 = hardware & 0xffff;
+            LOW->SR = ~TIM_SR_CC1IF;
+            LOW->DIER |= TIM_DIER_CC1IE;
+        } else {
+            HIGH->CCR1 = hardware >> 16;
+            HIGH->SR = ~TIM_SR_CC1IF;
+            HIGH->DIER |= TIM_DIER_CC1IE;
+        }
+        if (static_cast<int32_t>(now_us32() - compare_target) >= 0) {
+            compare_callback(); // Passed while arming, a duplicate call from the ISR is possible
+        }
+    }
+
+    void cancel_compare() {
+        LOW->DIER &= ~TIM_DIER_CC1IE;
+        HIGH->DIER &= ~TIM_DIER_CC1IE;
+    }
+
+    void cancel_short_compare() {
+        LOW->DIER &= ~TIM_DIER_CC2IE;
+    }
+
+    bool short_compare_pending() {
+        return LOW->DIER & TIM_DIER_CC2IE;
+    }
+
+    /**
+     * Calls the callback from interrupt context once now_us32() reaches target, on LOW CC2
+     * @param target Absolute time, less than 65536us ahead
+     * @param callback Must be short, e.g. post an event
+     */
+    void set_short_compare(uint32_t target, callback_t callback) {
+        cancel_short_compare();
+        short_target = target;
+        short_callback = callback;
+        LOW->CCR2 = (target - static_cast<uint32_t>(skew)) & 0xffff;
+        LOW->SR = ~TIM_SR_CC2IF;
+        LOW->DIER |= TIM_DIER_CC2IE;
+        if (static_cast<int32_t>(now_us32() - target) >= 0 && short_compare_pending()) {
+            cancel_short_compare();
+            callback(); // Passed while arming
+        }
+    }
+
+    /**
+     * Advances the timebase by time that passed while it was stopped, a compare that is now due fires.
+     * Call with interrupts masked
+     */
+    void skip(uint32_t us) {
+        skew += us;
+        if ((LOW->DIER | HIGH->DIER) & TIM_DIER_CC1IE) {
+            cancel_compare();
+            arm_compare();
+        }
+        if (LOW->DIER & TIM_DIER_CC2IE) {
+            set_short_compare(short_target, short_callback);
+        }
+    }
+
+    /**
+     * Calls the callback from interrupt context once now_us32() reaches target
+     * @param target Absolute time, at most 2^31us ahead
+     * @param callback Must be short, e.g. post an event
+     */
+    void set_compare(uint32_t target, callback_t callback) {
+        cancel_compare();
+        compare_target = target;
+        compare_callback = callback;
+        arm_compare();
+    }
+
+    /**
+     * Call from TIM3_IRQHandler
+     */
+    void irq_low() {
+        if (LOW->SR & TIM_SR_CC1IF) {
+            LOW->SR = ~TIM_SR_CC1IF;
+            if (LOW->DIER & TIM_DIER_CC1IE) {
+                LOW->DIER &= ~TIM_DIER_CC1IE;
+                compare_callback();
+            }
+        }
+        if (LOW->SR & TIM_SR_CC2IF) {
+            LOW->SR = ~TIM_SR_CC2IF;
+            if (LOW->DIER & TIM_DIER_CC2IE) {
+                LOW->DIER &= ~TIM_DIER_CC2IE;
+                short_callback();
+            }
+        }
+    }
+
+    /**
+     * Call from TIM4_IRQHandler
+     */
+    void irq_high() {
+        uint32_t sr = HIGH->SR;
+        if (sr & TIM_SR_UIF) {
+            uint32_t primask = __get_PRIMASK();
+            __disable_irq(); // Readers must never see the flag cleared but the count not yet incremented
+            overflows = overflows + 1;
+            HIGH->SR = ~TIM_SR_UIF;
+            __set_PRIMASK(primask);
+        }
+        if ((sr & TIM_SR_CC1IF) && (HIGH->DIER & TIM_DIER_CC1IE)) {
+            HIGH->SR = ~TIM_SR_CC1IF;
+            HIGH->DIER &= ~TIM_DIER_CC1IE;
+            arm_compare(); // Now within one LOW period
+        }
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_TIMEBASE_H
@@ -0,0 +1,248 @@
+/**
+ * @file timers.h
+ * Hierarchical software timer wheel driven by the compare of the microsecond timebase.\n
+ * Insert and cancel are O(1), the compare is always reprogrammed to the next slot that needs work,
+ * so an idle wheel causes no interrupts. Expired callbacks run in the event loop.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_TIMERS_H
+#define ALARM_CLOCK_LAMP_TIMERS_H
+
+#include "peripherals.h"
+#include "events.h"
+#include "timebase.h"
+
+namespace timers {
+    struct timer_t {
+        timer_t *next;
+        timer_t **pprev; // Points at the previous next pointer or the slot head, nullptr when not running
+        uint32_t expires; // Absolute tick
+        uint32_t period; // Reload in ticks, 0 for one shot timers
+        events::handler_t callback;
+        uint32_t arg;
+    };
+
+    constexpr uint8_t LEVELS = 4;
+    constexpr uint8_t SLOT_BITS = 5;
+    constexpr uint32_t SLOTS = 1 << SLOT_BITS;
+    constexpr uint32_t MAX_COMPARE_AHEAD = 60000; // Ticks, keeps the tick conversion far from the 32 bit us wrap
+
+    timer_t *slots[LEVELS][SLOTS];
+    uint32_t occupied[LEVELS]; // One bit per non empty slot
+    uint32_t base; // Next tick to process, every timer before it has fired
+    uint32_t ticks; // 1ms ticks derived from the timebase
+    uint32_t last_us;
+    uint32_t partial_us; // Microseconds since the last whole tick
+
+    /**
+     * Current tick in ms, only call from thread mode
+     */
+    uint32_t now() {
+        uint32_t us = timebase::now_us32();
+        partial_us += us - last_us;
+        last_us = us;
+        if (partial_us >= 1000) {
+            uint32_t elapsed = partial_us / 1000;
+            ticks += elapsed;
+            partial_us -= elapsed * 1000;
+        }
+        return ticks;
+    }
+
+    void unlink(timer_t &t) {
+        *t.pprev = t.next;
+        if (t.next) {
+            t.next->pprev = t.pprev;
+        }
+        t.pprev = nullptr;
+    }
+
+    /**
+     * Files a timer into the slot matching its distance to base
+     */
+    void place(timer_t &t) {
+        int32_t delta = static_cast<int32_t>(t.expires - base);
+        if (delta < 0) {
+            t.expires = base;
+            delta = 0;
+        }
+        uint8_t level = 0;
+        while (level < LEVELS - 1 && static_cast<uint32_t>(delta) >= 1UL << (SLOT_BITS * (level + 1))) {
+            level++;
+        }
+        uint32_t index;
+        if (static_cast<uint32_t>(delta) >= 1UL << (SLOT_BITS * LEVELS)) {
+            index = ((base >> (SLOT_BITS * level)) - 1) & (SLOTS - 1); // Too far out, park in the last slot
+        } else {
+            index = (t.expires >> (SLOT_BITS * level)) & (SLOTS - 1);
+        }
+        timer_t *&head = slots[level][index];
+        t.next = head;
+        t.pprev = &head;
+        if (head) {
+            head->pprev = &t.next;
+        }
+        head = &t;
+        occupied[level] |= 1UL << index;
+    }
+
+    /**
+     * Detaches a whole slot and refiles its timers relative to the current base
+     */
+    void cascade(uint8_t level, uint32_t index) {
+        timer_t *t = slots[level][index];
+        slots[level][index] = nullptr;
+        occupied[level] &= ~(1UL << index);
+        while (t) {
+            timer_t *next = t->next;
+            place(*t);
+            t = next;
+        }
+    }
+
+    /**
+     * Earliest tick at or after base at which a slot needs to be processed or cascaded
+     */
+    uint32_t next_work() {
+        uint32_t earliest = base + (1UL << (SLOT_BITS * LEVELS));
+        for (uint8_t level = 0; level < LEVELS; level++) {
+            if (!occupied[level]) {
+                continue;
+            }
+            uint8_t shift = SLOT_BITS * level;
+            uint32_t block = (base + (1UL << shift) - 1) >> shift; // First slot boundary not yet processed
+            uint32_t offset = __CLZ(__RBIT(__ROR(occupied[level], block & (SLOTS - 1))));
+            uint32_t tick = (block + offset) << shift;
+            if (static_cast<int32_t>(tick - earliest) < 0) {
+                earliest = tick;
+            }
+        }
+        return earliest;
+    }
+
+    /**
+     * Runs cascades and expired timers of the tick at base, then advances base
+     */
+    void run_tick() {
+        for (uint8_t level = 1; level < LEVELS; level++) {
+            uint8_t shift = SLOT_BITS * level;
+            if (base & ((1UL << shift) - 1)) {
+                break;
+            }
+            cascade(level, (base >> shift) & (SLOTS - 1));
+        }
+        uint32_t index = base & (SLOTS - 1);
+        timer_t *&head = slots[0][index];
+        while (head) {
+            timer_t &t = *head;
+            unlink(t);
+            if (t.period) {
+                t.expires += t.period;
+                place(t);
+            }
+            t.callback(t.arg); // May start or cancel any timer, including this one
+        }
+        occupied[0] &= ~(1UL << index);
+        base++;
+    }
+
+    bool empty() {
+        uint32_t any = 0;
+        for (uint32_t level : occupied) {
+            any |= level;
+        }
+        return !any;
+    }
+
+    /**
+     * Compare callback of the timebase, runs in interrupt context
+     */
+    void expired() {
+        events::post(events::TIMER_EXPIRED);
+    }
+
+    /**
+     * Points the compare at the next tick with work, or turns it off if the wheel is empty
+     */
+    void reprogram() {
+        if (empty()) {
+            timebase::cancel_compare();
+            return;
+        }
+        uint32_t current = now();
+        int32_t ahead = static_cast<int32_t>(next_work() - current);
+        if (ahead < 1) ahead = 1;
+        if (ahead > static_cast<int32_t>(MAX_COMPARE_AHEAD)) ahead = MAX_COMPARE_AHEAD;
+        timebase::set_compare(last_us + static_cast<uint32_t>(ahead) * 1000 - partial_us, expired);
+    }
+
+    /**
+     * Processes every tick up to now, skipping empty stretches. Subscribed to events::TIMER_EXPIRED
+     */
+    void process(uint32_t = 0) {
+        uint32_t target = now();
+        while (static_cast<int32_t>(target - base) >= 0) {
+            uint32_t next = next_work();
+            if (static_cast<int32_t>(next - target) > 0) {
+                base = target + 1;
+                break;
+            }
+            base = next;
+            run_tick();
+        }
+        reprogram();
+    }
+
+    /**
+     * Stops a timer, does nothing if it is not running
+     */
+    void cancel(timer_t &t) {
+        if (!t.pprev) {
+            return;
+        }
+        timer_t **head = t.pprev;
+        unlink(t);
+        if (head >= &slots[0][0] && head <= &slots[LEVELS - 1][SLOTS - 1] && !*head) {
+            uint32_t slot = static_cast<uint32_t>(head - &slots[0][0]);
+            occupied[slot / SLOTS] &= ~(1UL << (slot % SLOTS));
+        }
+    }
+
+    /**
+     * Starts or restarts a timer
+     * @param t The timer, must stay valid while running
+     * @param delay_ms Minimum time until the first expiry, it fires within one tick after it
+     * @param callback Called from the event loop on expiry
+     * @param arg Passed to the callback
+     * @param period_ms Reload for periodic timers, 0 for one shot
+     */
+    void start(timer_t &t, uint32_t delay_ms, events::handler_t callback, uint32_t arg = 0, uint32_t period_ms = 0) {
+        cancel(t);
+        uint32_t current = now();
+        if (empty()) {
+            base = current; // Nothing ran while idle, resync
+        }
+        t.expires = current + delay_ms + 1; // Rounded up on purpose: current drops partial_us, so never fire early
+        t.period = period_ms;
+        t.callback = callback;
+        t.arg = arg;
+        place(t);
+        reprogram();
+    }
+
+    bool active(const timer_t &t) {
+        return t.pprev != nullptr;
+    }
+
+    /**
+     * Call after timebase::init()
+     */
+    void init() {
+        last_us = timebase::now_us32();
+        events::subscribe(events::TIMER_EXPIRED, process);
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_TIMERS_H
@@ -0,0 +1,171 @@
+/**
+ * @file timesync.h
+ * Time synchronization with the remote over the radio link, disciplining the RTC rate.\n
+ * The remote sends TIME_SYNC with its time at the start of the transmission and the round trip of the previous
+ * sync, which it measured from that start until the ACK came in. The lamp takes its reception time from the
+ * nRF IRQ edge (EXTI3), so the event loop latency does not count, and pairs the round trip with the previous
+ * reception: offset = lamp reception - (remote transmission + round trip / 2).
+ * Samples with a long round trip are dropped, they went through retransmits and the halves are not symmetric.
+ * Waking from STOP delays the edge by the roughly constant clock restore, which shifts the offset but not the drift.
+ *
+ * Offsets of a second or more are stepped in whole seconds. The drift is the change of the offset since the
+ * reference sample, measured over at least DRIFT_MIN_S so that the few 10us of jitter vanish, and fed into the
+ * rate correction of the RTC: the first estimate fully, then low pass filtered against temperature and jitter.
+ * The reference lives in backup registers next to the correction, so neither a reset nor VBAT loses it.
+ * A pair of packets every few hours is plenty, two will do once a day.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_TIMESYNC_H
+#define ALARM_CLOCK_LAMP_TIMESYNC_H
+
+#include "peripherals.h"
+#include "timebase.h"
+#include "rtc.h"
+
+namespace timesync {
+    constexpr uint16_t RTT_MAX_US = 800; // Packet and ACK take ~500us at 1Mbps, a retransmit adds 1ms
+    constexpr uint16_t RTT_NONE = 0xffff;
+    constexpr uint32_t DRIFT_MIN_S = 3600;
+    constexpr uint32_t DRIFT_MAX_S = 60 * 86400; // Keeps the offset change in 32 bit
+    constexpr int32_t DRIFT_MAX_PPM = 200; // More is a clock set by other means, not drift
+    constexpr int32_t JITTER_US = 1000;
+    constexpr int64_t STEP_Q16 = 1 << 16;
+    constexpr uint8_t FILTER_SHIFT = 2; // Later estimates move the correction by 1/4
+
+    /**
+     * Backup registers after the ones of rtc.h
+     */
+    enum backup_t : uint8_t {
+        REF_SECONDS_LOW = rtc::BACKUP_FREE,
+        REF_SECONDS_HIGH,
+        REF_OFFSET_LOW, // 1/65536s, signed
+        REF_OFFSET_HIGH,
+        SAMPLES // Drift estimates so far, 0 = no reference
+    };
+
+    struct sample_t {
+        uint8_t seq;
+        bool valid;
+        uint64_t remote; // 1/65536s since the epoch
+        uint64_t local;
+    };
+
+    volatile uint32_t edge_us; // timebase::now_us32() at the last nRF IRQ edge
+    sample_t last;
+    int32_t offset_q16; // Of the last paired sample
+
+    constexpr uint64_t us_to_q16(uint32_t us) {
+        return static_cast<uint64_t>(us) * 281474977 >> 32; // 2^16 / 10^6 in Q32
+    }
+
+    constexpr int64_t q16_to_us(int64_t q16) {
+        return q16 * 15625 / 1024; // Divides by a power of 2, no library call
+    }
+
+    static_assert(us_to_q16(1000000) == 65536);
+    static_assert(q16_to_us(-65536) == -1000000);
+
+    /**
+     * Call from the nRF EXTI handler
+     */
+    void stamp_edge() {
+        edge_us = timebase::now_us32();
+    }
+
+    /**
+     * RTC time of the last nRF IRQ edge, call before the next edge can come
+     */
+    uint64_t edge_time() {
+        rtc::sync(); // May have woken from STOP
+        uint32_t now_us = timebase::now_us32();
+        uint64_t now = rtc::now_q16();
+        return now - us_to_q16(now_us - edge_us);
+    }
+
+    struct reference_t {
+        uint32_t seconds;
+        int64_t offset; // 1/65536s, stored as 32 bit
+    };
+
+    reference_t read_reference() {
+        uint32_t offset = rtc::backup_read(REF_OFFSET_LOW) | static_cast<uint32_t>(rtc::backup_read(REF_OFFSET_HIGH)) << 16;
+        return {rtc::backup_read(REF_SECONDS_LOW) | static_cast<uint32_t>(rtc::backup_read(REF_SECONDS_HIGH)) << 16,
+                static_cast<int32_t>(offset)};
+    }
+
+    void write_reference(const reference_t &reference) {
+        uint32_t offset = static_cast<uint32_t>(reference.offset);
+        rtc::backup_write(REF_SECONDS_LOW, static_cast<uint16_t>(reference.seconds));
+        rtc::backup_write(REF_SECONDS_HIGH, static_cast<uint16_t>(reference.seconds >> 16));
+        rtc::backup_write(REF_OFFSET_LOW, static_cast<uint16_t>(offset));
+        rtc::backup_write(REF_OFFSET_HIGH, static_cast<uint16_t>(offset >> 16));
+    }
+
+    /**
+     * Forgets the reference, for when the clock was set by other means
+     */
+    void invalidate() {
+        rtc::backup_write(SAMPLES, 0);
+    }
+
+    /**
+     * Updates the rate correction from the change of the offset since the reference and renews the reference.
+     * A step is applied to the reference as well, so it stays on the time scale of the clock
+     * @param seconds Local time of the offset
+     * @param offset Before the step
+     * @param step Seconds the clock is set back by
+     */
+    void discipline(uint32_t seconds, int64_t offset, int32_t step) {
+        uint16_t samples = rtc::backup_read(SAMPLES);
+        reference_t reference = read_reference();
+        uint32_t interval = seconds - reference.seconds;
+        int64_t delta_us = q16_to_us(offset - reference.offset);
+        int64_t limit_us = static_cast<int64_t>(DRIFT_MAX_PPM) * interval + JITTER_US;
+        if (!samples || interval > DRIFT_MAX_S || delta_us > limit_us || delta_us < -limit_us) {
+            reference = {seconds, offset}; // Set by other means or the first sync, no drift to tell
+            samples = 1;
+        } else if (interval >= DRIFT_MIN_S) {
+            int32_t drift_q4 = static_cast<int32_t>(delta_us) / static_cast<int32_t>(interval >> 4); // Offset grows when the lamp runs fast
+            int32_t correction = rtc::correction_q4();
+            correction += samples == 1 ? drift_q4 : drift_q4 / (1 << FILTER_SHIFT);
+            rtc::set_correction(correction);
+            reference = {seconds, offset};
+            if (samples < 0xffff) samples++;
+        } // Otherwise the baseline keeps growing
+        reference.seconds -= static_cast<uint32_t>(step);
+        reference.offset -= static_cast<int64_t>(step) << 16;
+        write_reference(reference);
+        rtc::backup_write(SAMPLES, samples);
+    }
+
+    /**
+     * Handles a TIME_SYNC packet, returns whether the clock was stepped
+     * @param seq Sequence number, consecutive for the round trip to pair
+     * @param remote Remote time at the start of the transmission in 1/65536s
+     * @param previous_rtt_us Round trip of the sync with seq - 1, RTT_NONE if it was not acknowledged
+     */
+    bool on_sync(uint8_t seq, uint64_t remote, uint16_t previous_rtt_us) {
+        sample_t previous = last;
+        last = {seq, true, remote, edge_time()};
+        if (!previous.valid || static_cast<uint8_t>(previous.seq + 1) != seq || previous_rtt_us > RTT_MAX_US) {
+            return false;
+        }
+        int64_t offset = static_cast<int64_t>(previous.local - previous.remote)
+                         - static_cast<int64_t>(us_to_q16(previous_rtt_us) / 2);
+        int32_t step = 0;
+        if (offset >= STEP_Q16 || offset <= -STEP_Q16) {
+            step = static_cast<int32_t>((offset + (1 << 15)) >> 16); // Rounded seconds
+            last.valid = false; // Its reception was on the old time scale
+        }
+        discipline(static_cast<uint32_t>(previous.local >> 16), offset, step);
+        if (step) {
+            rtc::set(rtc::now() - static_cast<uint32_t>(step));
+        }
+        offset_q16 = static_cast<int32_t>(offset - (static_cast<int64_t>(step) << 16));
+        return step != 0;
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_TIMESYNC_H
@@ -0,0 +1,418 @@
+/**
+ * @file tuner.h
+ * FM radio on the TEA5767, sequenced as async tasks on the non blocking I2C handler.\n
+ * Tuning picks the injection side with the weaker image, like the Philips application note:
+ * the level at f + 450kHz (image for high side) is compared to f - 450kHz (image for low side).
+ * A band scan stores the stations with their injection side in flash, so playing one later is a single write.\n
+ * The seek finds the strongest station within a time budget instead of the slow and unreliable hardware search:
+ * a coarse pass reads only the level on a grid over the whole band, where a probe shows signal it climbs
+ * in 100kHz steps to the peak of that station, then the strongest peaks are refined with the IF count,
+ * which rejects false stops (images and adjacent channel leakage show a level but an IF count out of range).
+ * A level probe takes 7ms, 6ms settle rounded up to the wheel tick plus the I2C, a refine probe 13ms.
+ * The grid is 400kHz, or as wide as needed to reach the band end within the budget minus the refine time,
+ * climbs only take the probes the grid can spare. Below ~480ms the grid gets wider than the skirt of
+ * a station, so one between two probes can go unseen.
+ * test/seek_test.cpp replays band profiles against a TEA5767 model: 52 probes and 364ms on an empty band,
+ * 62 to 67 probes and 470 to 525ms with 2 or 3 stations, 102 probes and 770ms with 11, the tune adds ~50ms.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_TUNER_H
+#define ALARM_CLOCK_LAMP_TUNER_H
+
+#include "TEA5767.h"
+#include "async.h"
+
+namespace tuner {
+    struct station_t {
+        uint16_t freq_10khz;
+        uint8_t level;
+        uint8_t flags;
+    };
+
+    enum station_flags_t : uint8_t {
+        HIGH_SIDE = 1,
+        STEREO = 2
+    };
+
+    constexpr uint8_t MAX_STATIONS = 32;
+    constexpr uint32_t STEP_KHZ = 100;
+    constexpr uint16_t SCAN_STEPS = (TEA5767::BAND_HIGH_KHZ - TEA5767::BAND_LOW_KHZ) / STEP_KHZ + 1;
+    constexpr uint32_t SETTLE_MS = 15; // PLL lock and level ADC
+    constexpr uint8_t MIN_LEVEL = 7;
+    constexpr uint8_t IMAGE_STEPS = 5; // 500kHz, the scan grid point closest to the 450kHz image offset
+
+    struct table_t {
+        uint16_t magic;
+        uint8_t count;
+        uint8_t reserved;
+        station_t stations[MAX_STATIONS];
+    };
+
+    /**
+     * Station table in storage page 4, rewritten after each scan
+     */
+    namespace store {
+        constexpr uint32_t BASE = flash::STORAGE + 4 * flash::PAGE_SIZE;
+        constexpr uint16_t MAGIC = 0x5445;
+
+        bool load(table_t &table) {
+            const table_t &stored = *reinterpret_cast<const table_t *>(BASE);
+            if (stored.magic != MAGIC || stored.count > MAX_STATIONS) {
+                return false;
+            }
+            table = stored;
+            return true;
+        }
+
+        bool save(table_t &table) {
+            table.magic = MAGIC;
+            return flash::erase_page(BASE) && flash::program(BASE, reinterpret_cast<const uint8_t *>(&table), sizeof(table));
+        }
+    }
+
+    TEA5767 tea;
+    async::task_t task;
+    table_t table;
+    uint32_t target_khz;
+    bool target_high_side;
+    bool target_standby;
+    uint8_t image_high, image_low;
+    uint16_t scan_step;
+    uint8_t scan_levels[SCAN_STEPS]; // Level, bit 7 set if the IF count was valid, bit 6 if stereo
+
+    constexpr uint32_t COARSE_SETTLE_MS = 6; // Enough for the level ADC, the IF count needs longer
+    constexpr uint32_t REFINE_SETTLE_MS = 12;
+    constexpr uint32_t COARSE_STEP_KHZ = 400;
+    constexpr uint8_t COARSE_SIGNAL_LEVEL = 4;
+    constexpr uint8_t CANDIDATES = 3;
+    constexpr uint8_t REFINE_POINTS = 3; // -100..+100kHz around a candidate
+    constexpr uint8_t IF_CENTER = 0x37;
+    constexpr uint32_t COARSE_PROBE_MS = COARSE_SETTLE_MS + 1; // Settle rounded up to the wheel tick, I2C included
+    constexpr uint32_t REFINE_PROBE_MS = REFINE_SETTLE_MS + 1;
+    constexpr uint32_t REFINE_RESERVE_MS = CANDIDATES * REFINE_POINTS * REFINE_PROBE_MS;
+
+    struct candidate_t {
+        uint32_t khz;
+        uint8_t level;
+    };
+
+    struct seek_stats_t {
+        uint32_t elapsed_ms;
+        uint16_t probes;
+        uint32_t found_khz; // 0 if nothing qualified
+    };
+
+    uint32_t seek_budget_ms;
+    uint32_t seek_start;
+    uint32_t seek_khz; // Current coarse probe
+    uint32_t coarse_step_khz;
+    uint32_t probe_khz;
+    int32_t climb_khz;
+    candidate_t peak;
+    candidate_t candidates[CANDIDATES];
+    uint8_t refine_candidate, refine_point;
+    uint32_t best_khz;
+    int16_t best_score;
+    seek_stats_t seek_stats;
+
+    /**
+     * @param reserve_ms Kept for later steps
+     */
+    bool over_budget(uint32_t reserve_ms) {
+        return timers::now() - seek_start + reserve_ms >= seek_budget_ms;
+    }
+
+    /**
+     * Coarse probes the budget has left before the refine
+     */
+    uint32_t coarse_probes_left() {
+        uint32_t used_ms = timers::now() - seek_start + REFINE_RESERVE_MS;
+        return seek_budget_ms > used_ms ? (seek_budget_ms - used_ms) / COARSE_PROBE_MS : 0;
+    }
+
+    /**
+     * Widest step that still reaches the band end with the probes the whole budget allows, 400kHz if they suffice
+     */
+    uint32_t plan_coarse_step() {
+        uint32_t probes = coarse_probes_left();
+        uint32_t span_khz = TEA5767::BAND_HIGH_KHZ - TEA5767::BAND_LOW_KHZ;
+        if (!probes) {
+            return span_khz + STEP_KHZ;
+        }
+        uint32_t step_khz = (span_khz + probes * STEP_KHZ - 1) / (probes * STEP_KHZ) * STEP_KHZ;
+        return step_khz > COARSE_STEP_KHZ ? step_khz : COARSE_STEP_KHZ;
+    }
+
+    /**
+     * A level probe beside the coarse grid fits if the probes left still cover the rest of the band at the planned step
+     */
+    bool climb_fits() {
+        return coarse_probes_left() >= 1 + (TEA5767::BAND_HIGH_KHZ - seek_khz) / coarse_step_khz;
+    }
+
+    /**
+     * Next probe of the climb from a coarse probe to the peak of its station, 0 once the peak is found
+     * or the climb would leave the half step around the coarse probe or the budget
+     */
+    uint32_t climb_next() {
+        if (!climb_khz) {
+            return 0;
+        }
+        uint32_t next_khz = static_cast<uint32_t>(static_cast<int32_t>(peak.khz) + climb_khz);
+        uint32_t distance_khz = next_khz > seek_khz ? next_khz - seek_khz : seek_khz - next_khz;
+        if (next_khz < TEA5767::BAND_LOW_KHZ || next_khz > TEA5767::BAND_HIGH_KHZ
+            || distance_khz > coarse_step_khz / 2 || !climb_fits()) {
+            return 0;
+        }
+        return next_khz;
+    }
+
+    /**
+     * Keeps the strongest peaks, a neighbor of a kept peak replaces it only if stronger
+     */
+    void add_candidate(uint32_t khz, uint8_t level) {
+        for (candidate_t &c : candidates) {
+            if (c.level && (khz > c.khz ? khz - c.khz : c.khz - khz) < COARSE_STEP_KHZ) {
+                if (level > c.level) c = {khz, level};
+                return;
+            }
+        }
+        candidate_t *weakest = &candidates[0];
+        for (candidate_t &c : candidates) {
+            if (c.level < weakest->level) weakest = &c;
+        }
+        if (level > weakest->level) *weakest = {khz, level};
+    }
+
+    uint32_t station_khz(const station_t &station) {
+        return station.freq_10khz * 10UL;
+    }
+
+    /**
+     * Tunes to target_khz, choosing the injection side first
+     */
+    bool tune_body(async::task_t &t) {
+        ASYNC_BEGIN(t);
+        tea.set_standby(false);
+        tea.set_mute(true);
+        tea.set_frequency(target_khz + 450, true);
+        AWAIT_I2C(t, tea.handler(), tea.write());
+        AWAIT_DELAY_MS(t, SETTLE_MS);
+        AWAIT_I2C(t, tea.handler(), tea.read());
+        image_high = tea.level();
+        tea.set_frequency(target_khz - 450, true);
+        AWAIT_I2C(t, tea.handler(), tea.write());
+        AWAIT_DELAY_MS(t, SETTLE_MS);
+        AWAIT_I2C(t, tea.handler(), tea.read());
+        image_low = tea.level();
+        tea.set_frequency(target_khz, image_high < image_low);
+        tea.set_mute(false);
+        AWAIT_I2C(t, tea.handler(), tea.write());
+        AWAIT_DELAY_MS(t, SETTLE_MS);
+        AWAIT_I2C(t, tea.handler(), tea.read());
+        ASYNC_END(t);
+    }
+
+    /**
+     * Tunes to a known injection side in one write, used for stored stations
+     */
+    bool play_body(async::task_t &t) {
+        ASYNC_BEGIN(t);
+        tea.set_standby(false);
+        tea.set_frequency(target_khz, target_high_side);
+        tea.set_mute(false);
+        AWAIT_I2C(t, tea.handler(), tea.write());
+        AWAIT_DELAY_MS(t, SETTLE_MS);
+        AWAIT_I2C(t, tea.handler(), tea.read());
+        ASYNC_END(t);
+    }
+
+    bool standby_body(async::task_t &t) {
+        ASYNC_BEGIN(t);
+        tea.set_mute(target_standby);
+        tea.set_standby(target_standby);
+        AWAIT_I2C(t, tea.handler(), tea.write());
+        ASYNC_END(t);
+    }
+
+    /**
+     * Picks local level maxima with a valid IF count from the scan and stores them
+     */
+    void build_table() {
+        table.count = 0;
+        for (uint16_t i = 0; i < SCAN_STEPS && table.count < MAX_STATIONS; i++) {
+            uint8_t level = scan_levels[i] & 0x0f;
+            if (!(scan_levels[i] & 0x80) || level < MIN_LEVEL) continue;
+            if (i > 0 && (scan_levels[i - 1] & 0x0f) > level) continue;
+            if (i + 1 < SCAN_STEPS && (scan_levels[i + 1] & 0x0f) >= level) continue;
+            uint8_t above = i + IMAGE_STEPS < SCAN_STEPS ? scan_levels[i + IMAGE_STEPS] & 0x0f : 0;
+            uint8_t below = i >= IMAGE_STEPS ? scan_levels[i - IMAGE_STEPS] & 0x0f : 0;
+            station_t &station = table.stations[table.count++];
+            station.freq_10khz = static_cast<uint16_t>((TEA5767::BAND_LOW_KHZ + i * STEP_KHZ) / 10);
+            station.level = level;
+            station.flags = static_cast<uint8_t>((above < below ? HIGH_SIDE : 0) | (scan_levels[i] & 0x40 ? STEREO : 0));
+        }
+        store::save(table);
+    }
+
+    /**
+     * Steps through the band on high side injection, muted
+     */
+    bool scan_body(async::task_t &t) {
+        ASYNC_BEGIN(t);
+        tea.set_standby(false);
+        tea.set_mute(true);
+        for (scan_step = 0; scan_step < SCAN_STEPS; scan_step++) {
+            tea.set_frequency(TEA5767::BAND_LOW_KHZ + scan_step * STEP_KHZ, true);
+            AWAIT_I2C(t, tea.handler(), tea.write());
+            AWAIT_DELAY_MS(t, SETTLE_MS);
+            AWAIT_I2C(t, tea.handler(), tea.read());
+            scan_levels[scan_step] = static_cast<uint8_t>(tea.level() | (tea.if_valid() ? 0x80 : 0) | (tea.stereo() ? 0x40 : 0));
+        }
+        build_table();
+        ASYNC_END(t);
+    }
+
+    bool seek_body(async::task_t &t) {
+        ASYNC_BEGIN(t);
+        tea.set_standby(false);
+        tea.set_mute(true);
+        for (candidate_t &c : candidates) c = {};
+        coarse_step_khz = plan_coarse_step();
+        seek_khz = probe_khz = TEA5767::BAND_LOW_KHZ;
+        while (seek_khz <= TEA5767::BAND_HIGH_KHZ && !over_budget(REFINE_RESERVE_MS)) {
+            tea.set_frequency(probe_khz, true);
+            AWAIT_I2C(t, tea.handler(), tea.write());
+            AWAIT_DELAY_MS(t, COARSE_SETTLE_MS);
+            AWAIT_I2C(t, tea.handler(), tea.read());
+            seek_stats.probes++;
+            if (probe_khz == seek_khz) {
+                peak = {seek_khz, tea.level()};
+                climb_khz = tea.level() >= COARSE_SIGNAL_LEVEL ? static_cast<int32_t>(STEP_KHZ) : 0;
+            } else if (tea.level() > peak.level) {
+                peak = {probe_khz, tea.level()};
+            } else if (climb_khz > 0 && peak.khz == seek_khz) {
+                climb_khz = -static_cast<int32_t>(STEP_KHZ); // Falls above the coarse probe, try below
+            } else {
+                climb_khz = 0;
+            }
+            probe_khz = climb_next();
+            if (!probe_khz) {
+                if (peak.level >= COARSE_SIGNAL_LEVEL) {
+                    add_candidate(peak.khz, peak.level);
+                }
+                seek_khz += coarse_step_khz;
+                probe_khz = seek_khz;
+            }
+        }
+        if (probe_khz != seek_khz && peak.level >= COARSE_SIGNAL_LEVEL) {
+            add_candidate(peak.khz, peak.level); // Climb cut short by the budget
+        }
+        best_khz = 0;
+        best_score = 0;
+        for (refine_candidate = 0; refine_candidate < CANDIDATES; refine_candidate++) {
+            if (!candidates[refine_candidate].level) continue;
+            for (refine_point = 0; refine_point < REFINE_POINTS && !over_budget(REFINE_PROBE_MS); refine_point++) {
+                seek_khz = candidates[refine_candidate].khz + refine_point * STEP_KHZ - (REFINE_POINTS / 2) * STEP_KHZ;
+                if (seek_khz < TEA5767::BAND_LOW_KHZ || seek_khz > TEA5767::BAND_HIGH_KHZ) continue;
+                tea.set_frequency(seek_khz, true);
+                AWAIT_I2C(t, tea.handler(), tea.write());
+                AWAIT_DELAY_MS(t, REFINE_SETTLE_MS);
+                AWAIT_I2C(t, tea.handler(), tea.read());
+                seek_stats.probes++;
+                if (tea.if_valid()) {
+                    uint8_t if_offset = static_cast<uint8_t>(tea.if_count() > IF_CENTER ? tea.if_count() - IF_CENTER : IF_CENTER - tea.if_count());
+                    int16_t score = static_cast<int16_t>(tea.level() * 16 - if_offset);
+                    if (score > best_score) {
+                        best_score = score;
+                        best_khz = seek_khz;
+                    }
+                }
+            }
+        }
+        seek_stats.elapsed_ms = timers::now() - seek_start;
+        seek_stats.found_khz = best_khz;
+        if (best_khz) {
+            target_khz = best_khz;
+            async::chain(t, tune_body); // Injection side choice and unmute
+            return false;
+        }
+        ASYNC_END(t);
+    }
+
+    bool busy() {
+        return async::running(task);
+    }
+
+    /**
+     * @return false while another tuner operation runs
+     */
+    bool tune(uint32_t khz) {
+        if (khz < TEA5767::BAND_LOW_KHZ || khz > TEA5767::BAND_HIGH_KHZ) {
+            return false;
+        }
+        target_khz = khz;
+        return async::start(task, tune_body);
+    }
+
+    /**
+     * Full band scan, takes SCAN_STEPS * SETTLE_MS ~ 3s
+     */
+    bool scan() {
+        return async::start(task, scan_body);
+    }
+
+    bool play(uint8_t index) {
+        if (index >= table.count) {
+            return false;
+        }
+        target_khz = station_khz(table.stations[index]);
+        target_high_side = table.stations[index].flags & HIGH_SIDE;
+        return async::start(task, play_body);
+    }
+
+    /**
+     * Plays the strongest stored station, for waking to the radio
+     */
+    bool play_strongest() {
+        uint8_t best = 0;
+        for (uint8_t i = 1; i < table.count; i++) {
+            if (table.stations[i].level > table.stations[best].level) best = i;
+        }
+        return play(best);
+    }
+
+    /**
+     * Finds and tunes the strongest station, results in seek_stats
+     * @param budget_ms Time for the search, the final tune takes another ~50ms
+     */
+    bool seek(uint32_t budget_ms) {
+        if (busy()) {
+            return false;
+        }
+        seek_budget_ms = budget_ms;
+        seek_start = timers::now();
+        seek_stats = {};
+        return async::start(task, seek_body);
+    }
+
+    bool standby(bool on) {
+        target_standby = on;
+        return async::start(task, standby_body);
+    }
+
+    /**
+     * Loads the stored stations and puts the tuner into standby
+     */
+    void init(I2C_Handler *handler) {
+        tea.set_i2c_handler(handler);
+        if (!store::load(table)) {
+            table.count = 0;
+        }
+        standby(true);
+    }
+}
+
+#endif //ALARM_CLOCK_LAMP_TUNER_H
@@ -1,54 +1,630 @@
 #include "peripherals.h"
 #include "system.h"
 #include "STMF1_SPI_Handler.h"
+#include "STMF1_I2C_Handler.h"
 #include "nRF24.h"
+#include "protocol.h"
+#include "latency.h"
+#include "events.h"
+#include "timebase.h"
+#include "timers.h"
+#include "async.h"
+#include "power.h"
+#include "irq.h"
+#include "pwm.h"
+#include "brightness.h"
+#include "cct.h"
+#include "curve.h"
+#include "effects.h"
+#include "tuner.h"
+#include "buzzer.h"
+#include "audio.h"
+#include "speaker.h"
+#include "buttons.h"
+#include "exti.h"
+#include "rtc.h"
+#include "alarms.h"
+#include "timesync.h"
 
 STMF1_SPI_Handler nrf_spi_handler;
+STMF1_I2C_Handler tea_i2c_handler;
 nRF24 nRF;
-uint8_t rx_buffer[32];
+uint8_t rx_buffer[33];
+uint8_t ack_buffer[33];
+async::task_t nrf_power_up_task;
+
+/**
+ * Queues a reply for the next received packet, ack_buffer[1] onwards has to be filled already
+ * @param length Number of reply bytes without the command byte
+ */
+void send_reply(uint8_t length) {
+    nRF.write_ack_payload(ack_buffer, static_cast<uint8_t>(length + 1), 0);
+}
+
+/**
+ * Executes a received command
+ * @param payload The received bytes, starting with the command
+ * @param length Number of received bytes
+ */
+void handle_command(const uint8_t *payload, uint8_t length) {
+    if (length == 0) {
+        return;
+    }
+    latency::stamp(latency::CMD_PARSED);
+    switch (payload[0]) {
+#ifdef LATENCY_STATS
+        case protocol::LATENCY_SUMMARY: {
+            if (length < 2 || payload[1] >= latency::STAGE_COUNT) break;
+            const latency::stats_t &s = latency::stats[payload[1]];
+            ack_buffer[1] = payload[1];
+            protocol::put_u32(ack_buffer + 2, s.min);
+            protocol::put_u32(ack_buffer + 6, latency::average(s));
+            protocol::put_u32(ack_buffer + 10, s.max);
+            protocol::put_u32(ack_buffer + 14, s.count);
+            send_reply(17);
+            break;
+        }
+        case protocol::LATENCY_HISTOGRAM: {
+            if (length < 3 || payload[1] >= latency::STAGE_COUNT) break;
+            const latency::stats_t &s = latency::stats[payload[1]];
+            ack_buffer[1] = payload[1];
+            ack_buffer[2] = payload[2];
+            for (uint8_t i = 0; i < 14; i++) {
+                uint8_t bucket = static_cast<uint8_t>(payload[2] + i);
+                protocol::put_u16(ack_buffer + 3 + 2 * i, bucket < latency::HIST_BUCKETS ? s.hist[bucket] : 0);
+            }
+            send_reply(30);
+            break;
+        }
+        case protocol::LATENCY_RESET:
+            latency::reset();
+            break;
+#else
+        case protocol::LATENCY_SUMMARY:
+        case protocol::LATENCY_HISTOGRAM:
+        case protocol::LATENCY_RESET:
+            ack_buffer[1] = protocol::UNSUPPORTED;
+            send_reply(1);
+            break;
+#endif
+        case protocol::POWER_STATS:
+            power::account();
+            protocol::put_u32(ack_buffer + 1, power::stats.sleeps);
+            protocol::put_u32(ack_buffer + 5, power::stats.stops);
+            protocol::put_u32(ack_buffer + 9, power::stats.wake_cycles_last);
+            protocol::put_u32(ack_buffer + 13, power::stats.wake_cycles_max);
+            protocol::put_u16(ack_buffer + 17, power::stats.exit_us_last);
+            protocol::put_u16(ack_buffer + 19, power::stats.exit_us_max);
+            protocol::put_u32(ack_buffer + 21, power::stats.timed_stops);
+            protocol::put_u32(ack_buffer + 25, power::stop_ms());
+            protocol::put_u32(ack_buffer + 29, power::total_ms());
+            send_reply(32);
+            break;
+        case protocol::IRQ_LATENCY_BENCH:
+            if (length < 3) break;
+            irq::bench::run(protocol::get_u16(payload + 1));
+            for (uint8_t i = 0; i < irq::LEVEL_COUNT; i++) {
+                protocol::put_u32(ack_buffer + 1 + 4 * i, irq::bench::worst[i]);
+            }
+            send_reply(4 * irq::LEVEL_COUNT);
+            break;
+        case protocol::LIGHT_SET:
+            if (length < 5) break;
+            brightness::set(protocol::get_u16(payload + 1), protocol::get_u16(payload + 3));
+            break;
+        case protocol::LIGHT_FADE:
+            if (length < 9) break;
+            brightness::fade(protocol::get_u16(payload + 1), protocol::get_u16(payload + 3), protocol::get_u32(payload + 5));
+            break;
+        case protocol::LIGHT_CCT_SET:
+            if (length < 5) break;
+            curve::stop();
+            effects::stop();
+            cct::set(protocol::get_u16(payload + 1), protocol::get_u16(payload + 3));
+            break;
+        case protocol::LIGHT_CCT_FADE:
+            if (length < 9) break;
+            curve::stop();
+            effects::stop();
+            cct::fade(protocol::get_u16(payload + 1), protocol::get_u16(payload + 3), protocol::get_u32(payload + 5));
+            break;
+        case protocol::LIGHT_CALIBRATION:
+            if (length < 2) break;
+            cct::select_batch(payload[1]);
+            break;
+        case protocol::CURVE_PLAY:
+            if (length < 3) break;
+            effects::stop();
+            ack_buffer[1] = curve::play(payload[1], payload[2]);
+            send_reply(1);
+            break;
+        case protocol::CURVE_STOP:
+            curve::stop();
+            break;
+        case protocol::CURVE_ERASE:
+            if (length < 2) break;
+            ack_buffer[1] = curve::store::erase(payload[1]);
+            send_reply(1);
+            break;
+        case protocol::CURVE_WRITE:
+            if (length < 4) break;
+            ack_buffer[1] = curve::store::write(payload[1], protocol::get_u16(payload + 2), payload + 4,
+                                                static_cast<uint8_t>(length - 4));
+            send_reply(1);
+            break;
+        case protocol::CURVE_COMMIT:
+            if (length < 4) break;
+            ack_buffer[1] = curve::store::commit(payload[1], protocol::get_u16(payload + 2));
+            send_reply(1);
+            break;
+        case protocol::PWM_MODE:
+            if (length < 2) break;
+            pwm::set_mode(static_cast<pwm::mode_t>(payload[1]));
+            break;
+        case protocol::PWM_REPORT:
+            ack_buffer[1] = static_cast<uint8_t>(pwm::mode - pwm::modes);
+            protocol::put_u16(ack_buffer + 2, pwm::mode->period);
+            protocol::put_u16(ack_buffer + 4, pwm::mode->bits_q8);
+            protocol::put_u16(ack_buffer + 6, static_cast<uint16_t>(pwm::refills_per_s()));
+            protocol::put_u32(ack_buffer + 8, pwm::stats.cycles_last);
+            protocol::put_u32(ack_buffer + 12, pwm::stats.cycles_max);
+            protocol::put_u16(ack_buffer + 16, static_cast<uint16_t>(pwm::load_permille()));
+            send_reply(17);
+            break;
+        case protocol::EFFECT_START:
+            if (length < 9) break;
+            curve::stop();
+            effects::start(static_cast<effects::effect_t>(payload[1]),
+                           {protocol::get_u16(payload + 2), protocol::get_u16(payload + 4),
+                            protocol::get_u16(payload + 6), payload[8]});
+            break;
+        case protocol::EFFECT_STOP:
+            effects::stop();
+            break;
+        case protocol::EFFECT_STATS:
+            protocol::put_u32(ack_buffer + 1, effects::stats.ticks);
+            protocol::put_u32(ack_buffer + 5, effects::stats.cycles_last);
+            protocol::put_u32(ack_buffer + 9, effects::stats.cycles_max);
+            protocol::put_u32(ack_buffer + 13, effects::stats.overruns);
+            send_reply(16);
+            break;
+        case protocol::TUNER_TUNE:
+            if (length < 5) break;
+            ack_buffer[1] = tuner::tune(protocol::get_u32(payload + 1));
+            send_reply(1);
+            break;
+        case protocol::TUNER_SCAN:
+            ack_buffer[1] = tuner::scan();
+            send_reply(1);
+            break;
+        case protocol::TUNER_PLAY:
+            if (length < 2) break;
+            ack_buffer[1] = tuner::play(payload[1]);
+            send_reply(1);
+            break;
+        case protocol::TUNER_STANDBY:
+            if (length < 2) break;
+            ack_buffer[1] = tuner::standby(payload[1]);
+            send_reply(1);
+            break;
+        case protocol::TUNER_STATUS:
+            ack_buffer[1] = tuner::busy();
+            protocol::put_u32(ack_buffer + 2, tuner::tea.frequency_khz());
+            ack_buffer[6] = tuner::tea.level();
+            ack_buffer[7] = tuner::tea.if_count();
+            ack_buffer[8] = tuner::tea.stereo();
+            ack_buffer[9] = tuner::tea.high_side();
+            ack_buffer[10] = tea_i2c_handler.result();
+            ack_buffer[11] = tuner::table.count;
+            send_reply(11);
+            break;
+        case protocol::TUNER_STATIONS: {
+            if (length < 2) break;
+            ack_buffer[1] = payload[1];
+            for (uint8_t i = 0; i < 7; i++) {
+                uint8_t index = static_cast<uint8_t>(payload[1] + i);
+                tuner::station_t station = index < tuner::table.count ? tuner::table.stations[index] : tuner::station_t{};
+                protocol::put_u16(ack_buffer + 2 + 4 * i, station.freq_10khz);
+                ack_buffer[4 + 4 * i] = station.level;
+                ack_buffer[5 + 4 * i] = station.flags;
+            }
+            send_reply(29);
+            break;
+        }
+        case protocol::TUNER_SEEK:
+            if (length < 3) break;
+            ack_buffer[1] = tuner::seek(protocol::get_u16(payload + 1));
+            send_reply(1);
+            break;
+        case protocol::TUNER_SEEK_STATS:
+            protocol::put_u32(ack_buffer + 1, tuner::seek_stats.elapsed_ms);
+            protocol::put_u16(ack_buffer + 5, tuner::seek_stats.probes);
+            protocol::put_u32(ack_buffer + 7, tuner::seek_stats.found_khz);
+            send_reply(10);
+            break;
+        case protocol::BUZZER_PLAY:
+            if (length < 6) break;
+            audio::stop();
+            speaker::release();
+            ack_buffer[1] = payload[1] < buzzer::MELODY_COUNT;
+            buzzer::play(payload[1], payload[2], payload[3], payload[4], payload[5]);
+            send_reply(1);
+            break;
+        case protocol::BUZZER_STOP:
+            buzzer::stop();
+            break;
+        case protocol::AUDIO_PLAY:
+            if (length < 3) break;
+            speaker::release();
+            ack_buffer[1] = audio::play(payload[1], payload[2]);
+            send_reply(1);
+            break;
+        case protocol::AUDIO_STOP:
+            audio::stop();
+            break;
+        case protocol::AUDIO_ERASE:
+            audio::stop(); // May be playing from the pages
+            ack_buffer[1] = audio::store::erase();
+            send_reply(1);
+            break;
+        case protocol::AUDIO_WRITE:
+            if (length < 3) break;
+            ack_buffer[1] = audio::store::write(protocol::get_u16(payload + 1), payload + 3,
+                                                static_cast<uint8_t>(length - 3));
+            send_reply(1);
+            break;
+        case protocol::AUDIO_COMMIT:
+            if (length < 3) break;
+            ack_buffer[1] = audio::store::commit(protocol::get_u16(payload + 1));
+            send_reply(1);
+            break;
+        case protocol::AUDIO_STATS:
+            protocol::put_u32(ack_buffer + 1, audio::stats.blocks);
+            protocol::put_u32(ack_buffer + 5, audio::stats.cycles_last);
+            protocol::put_u32(ack_buffer + 9, audio::stats.cycles_max);
+            protocol::put_u32(ack_buffer + 13, audio::stats.late);
+            send_reply(16);
+            break;
+        case protocol::SPEAKER_VOLUME:
+            if (length < 6) break;
+            speaker::fade(payload[1], protocol::get_u32(payload + 2));
+            break;
+        case protocol::RTC_SET:
+            if (length < 5) break;
+            rtc::set(protocol::get_u32(payload + 1));
+            timesync::invalidate();
+            alarms::rebuild();
+            break;
+        case protocol::RTC_GET: {
+            rtc::sync(); // May have woken from STOP
+            uint32_t seconds = rtc::now();
+            rtc::datetime_t dt = rtc::to_datetime(seconds);
+            protocol::put_u32(ack_buffer + 1, seconds);
+            protocol::put_u16(ack_buffer + 5, dt.year);
+            ack_buffer[7] = dt.month;
+            ack_buffer[8] = dt.day;
+            ack_buffer[9] = dt.hour;
+            ack_buffer[10] = dt.minute;
+            ack_buffer[11] = dt.second;
+            ack_buffer[12] = dt.weekday;
+            ack_buffer[13] = rtc::source;
+            send_reply(13);
+            break;
+        }
+        case protocol::ALARM_SET: {
+            if (length < 8) break;
+            alarms::alarm_t alarm{protocol::get_u16(payload + 2), payload[4], payload[5], payload[6], payload[7], 0};
+            ack_buffer[1] = alarms::set(payload[1], alarm);
+            send_reply(1);
+            break;
+        }
+        case protocol::ALARM_SKIP:
+            if (length < 3) break;
+            ack_buffer[1] = alarms::skip_next(payload[1], payload[2]);
+            send_reply(1);
+            break;
+        case protocol::ALARM_HOLIDAY: {
+            if (length < 4) break;
+            uint16_t day = protocol::get_u16(payload + 1);
+            ack_buffer[1] = payload[3] ? alarms::add_holiday(day) : alarms::remove_holiday(day);
+            send_reply(1);
+            break;
+        }
+        case protocol::ALARM_GET: {
+            if (length < 2 || payload[1] >= alarms::MAX_ALARMS) break;
+            const alarms::alarm_t &alarm = alarms::table.alarms[payload[1]];
+            ack_buffer[1] = payload[1];
+            protocol::put_u16(ack_buffer + 2, alarm.minute);
+            ack_buffer[4] = alarm.weekdays;
+            ack_buffer[5] = alarm.flags;
+            ack_buffer[6] = alarm.action;
+            ack_buffer[7] = alarm.arg;
+            protocol::put_u32(ack_buffer + 8, alarms::next_fire[payload[1]]);
+            send_reply(11);
+            break;
+        }
+        case protocol::ALARM_NEXT:
+            protocol::put_u32(ack_buffer + 1, alarms::next());
+            send_reply(4);
+            break;
+        case protocol::TIME_SYNC: {
+            if (length < 10) break;
+            uint64_t remote = static_cast<uint64_t>(protocol::get_u32(payload + 2)) << 16 | protocol::get_u16(payload + 6);
+            if (timesync::on_sync(payload[1], remote, protocol::get_u16(payload + 8))) {
+                alarms::rebuild();
+            }
+            ack_buffer[1] = payload[1];
+            protocol::put_u32(ack_buffer + 2, static_cast<uint32_t>(timesync::last.local >> 16));
+            protocol::put_u16(ack_buffer + 6, static_cast<uint16_t>(timesync::last.local));
+            protocol::put_u32(ack_buffer + 8, static_cast<uint32_t>(timesync::offset_q16));
+            protocol::put_u16(ack_buffer + 12, static_cast<uint16_t>(rtc::correction_q4()));
+            protocol::put_u16(ack_buffer + 14, rtc::backup_read(timesync::SAMPLES));
+            send_reply(15);
+            break;
+        }
+        case protocol::SPEAKER_STATS:
+            ack_buffer[1] = speaker::volume();
+            protocol::put_u32(ack_buffer + 2, speaker::stats.frames);
+            protocol::put_u32(ack_buffer + 6, speaker::stats.cycles_last);
+            protocol::put_u32(ack_buffer + 10, speaker::stats.cycles_max);
+            send_reply(13);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Local control: On/Off toggles the light, a double press the radio and holding it brightens in steps.
+ * All-off switches everything off
+ */
+void on_button(uint32_t arg) {
+    constexpr uint16_t LIGHT_ON_LEVEL = 40000;
+    constexpr uint16_t LIGHT_STEP = 4096;
+    constexpr uint8_t RADIO_VOLUME = 10;
+    uint8_t gesture = static_cast<uint8_t>(arg >> 8);
+    curve::stop();
+    effects::stop();
+    if ((arg & 0xff) == buttons::ALL_OFF) {
+        cct::set(0, cct::kelvin());
+        buzzer::stop();
+        audio::stop();
+        speaker::set(0);
+        tuner::standby(true);
+        return;
+    }
+    uint32_t level = cct::current();
+    switch (gesture) {
+        case buttons::SHORT:
+            cct::fade(level ? 0 : LIGHT_ON_LEVEL, cct::kelvin(), 500);
+            break;
+        case buttons::DOUBLE:
+            if (speaker::volume()) {
+                speaker::fade(0, 500);
+            } else {
+                tuner::play_strongest();
+                speaker::fade(RADIO_VOLUME, 2000);
+            }
+            break;
+        case buttons::LONG:
+        case buttons::REPEAT:
+            level += LIGHT_STEP;
+            cct::fade(static_cast<uint16_t>(level > 0xffff ? 0xffff : level), cct::kelvin(), buttons::REPEAT_MS);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Starts what a due alarm asks for, sounds escalate in volume
+ */
+void on_alarm(uint8_t, const alarms::alarm_t &alarm) {
+    switch (alarm.action) {
+        case protocol::ALARM_CURVE:
+            effects::stop();
+            curve::play(alarm.arg);
+            break;
+        case protocol::ALARM_BUZZER:
+            audio::stop();
+            speaker::release();
+            buzzer::play(alarm.arg, 32, 255, 16, true);
+            break;
+        case protocol::ALARM_AUDIO:
+            speaker::release();
+            audio::play(alarm.arg, 255);
+            break;
+        case protocol::ALARM_RADIO:
+            tuner::play_strongest();
+            speaker::fade(alarm.arg, 30000);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * The nRF IRQ line went low
+ */
+void on_nrf_edge() {
+    latency::stamp(latency::EXTI_EDGE);
+    timesync::stamp_edge();
+    events::post(events::RADIO_IRQ);
+}
+
+constexpr exti::binding_t exti_bindings[] = {
+    {gpio::BANK_A, 3, exti::FALLING, on_nrf_edge},
+    {gpio::BANK_A, 11, exti::FALLING, buttons::irq},
+    {gpio::BANK_A, 12, exti::FALLING, buttons::irq},
+};
+using exti_lines = exti::registry_t<exti_bindings>;
+
+/**
+ * Reads and handles the received payload, posted by the nRF IRQ line
+ */
+void on_radio_irq(uint32_t) {
+    GPIOC->ODR ^= 1 << 13;
+    nRF.write_reg(nRF24::STATUS, 0xff);
+    latency::stamp(latency::STATUS_READ);
+    uint8_t length = nRF.get_payload_length();
+    if (length > 32) {
+        nRF.flush_rx(); // Corrupt length, datasheet says to flush
+    } else {
+        nRF.read_payload(rx_buffer, static_cast<uint8_t>(length + 1));
+        latency::stamp(latency::PAYLOAD_DONE);
+        handle_command(rx_buffer + 1, length);
+    }
+    latency::commit();
+}
+
+/**
+ * Configures the nRF after its power on reset and puts it into RX mode
+ */
+bool nrf_power_up(async::task_t &task) {
+    ASYNC_BEGIN(task);
+    AWAIT_DELAY_MS(task, 100); // Wait 100ms for nRF poweron reset
+    nRF.reset();
+    AWAIT_SPI(task, nrf_spi_handler, nRF.write_reg_async(nRF24::EN_AA, 0x01));
+    AWAIT_SPI(task, nrf_spi_handler, nRF.write_reg_async(nRF24::EN_RXADDR, 0x01)); // Enable pipe 0
+    AWAIT_SPI(task, nrf_spi_handler, nRF.write_reg_async(nRF24::SETUP_RETR, 0x35)); // 5 retries, 1ms delay
+    AWAIT_SPI(task, nrf_spi_handler, nRF.write_reg_async(nRF24::RF_CH, 0x14)); // Channel 20
+    AWAIT_SPI(task, nrf_spi_handler, nRF.write_reg_async(nRF24::RF_SETUP, 0x07)); // 0dBm, 1Mbps
+    AWAIT_SPI(task, nrf_spi_handler, nRF.write_reg_async(nRF24::RX_PW_P0, 32)); // 32 byte packet
+    AWAIT_SPI(task, nrf_spi_handler, nRF.write_reg_async(nRF24::FEATURE, nRF24::EN_DPL | nRF24::EN_ACK_PAY | nRF24::EN_DYN_ACK));
+    AWAIT_SPI(task, nrf_spi_handler, nRF.write_reg_async(nRF24::DYNPD, 0x01)); // ACK payloads need dynamic payload length
+    AWAIT_SPI(task, nrf_spi_handler, nRF.write_reg_async(nRF24::CONFIG, 0x0f)); // 2 byte CRC, PRX, power up
+    AWAIT_DELAY_MS(task, 2); // Wait 2ms for power up
+    gpio::set(GPIOA, 2);
+    AWAIT_DELAY_US(task, 130); // RX settling
+    ASYNC_END(task);
+}
 
 int main() {
     rcc::clock_init_hse_pll_72MHz();
+    irq::config();
     system::enable_all_periphs();
     system::config_gpios();
+    exti_lines::config();
     system::config_for_nrf(SPI1);
     system::config_for_tea(I2C2);
     nrf_spi_handler.set_periphs(SPI1, DMA1_Channel3, DMA1_Channel2, GPIOA, 4);
     nrf_spi_handler.config_periph();
     nRF.set_spi_handler(&nrf_spi_handler);
+    tea_i2c_handler.set_periphs(I2C2, DMA1_Channel4, DMA1_Channel5, GPIOB, 10, 11);
+    tea_i2c_handler.config_periph();
+    latency::init();
+    events::subscribe(events::RADIO_IRQ, on_radio_irq);
+    events::subscribe(events::BUTTON_GESTURE, on_button);
+    timebase::init();
+    timers::init();
+    async::init();
+    pwm::init();
+    cct::init();
+    effects::init();
+    buzzer::init();
+    audio::init();
+    speaker::init();
+    buttons::init();
+    rtc::init();
+    power::init();
+    alarms::init(on_alarm);
 
     NVIC_EnableIRQ(EXTI3_IRQn);
+    NVIC_EnableIRQ(EXTI15_10_IRQn);
+    NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+    NVIC_EnableIRQ(I2C2_EV_IRQn);
+    NVIC_EnableIRQ(I2C2_ER_IRQn);
+    NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+    NVIC_EnableIRQ(DMA1_Channel7_IRQn);
     gpio::config(GPIOC, 13, gpio::OUT_PUSHPULL);
     gpio::set(GPIOC, 13);
 
-    tim::blocking_delay(TIM2, 36000, 100); // Wait 100ms for nRF poweron reset
-    nRF.reset();
-    nRF.write_reg(nRF24::EN_AA, 0x01);
-    nRF.write_reg(nRF24::EN_RXADDR, 0x01); // Enable pipe 0
-    nRF.write_reg(nRF24::SETUP_RETR, 0x35); // 5 retries, 1ms delay
-    nRF.write_reg(nRF24::RF_CH, 0x14); // Channel 20
-    nRF.write_reg(nRF24::RF_SETUP, 0x07); // 0dBm, 1Mbps
-    nRF.write_reg(nRF24::RX_PW_P0, 32); // 32 byte packet
-    nRF.write_reg(nRF24::FEATURE, nRF24::EN_DYN_ACK);
-    nRF.write_reg(nRF24::CONFIG, 0x0f); // 2 byte CRC, PRX, power up
-    tim::blocking_delay(TIM2, 36000, 2); // Wait 2ms for power up
-    gpio::set(GPIOA, 2);
-    tim::blocking_delay(TIM2, 36000, 2);
+    async::start(nrf_power_up_task, nrf_power_up);
+    tuner::init(&tea_i2c_handler);
     //uint8_t payload[] = {0x00, 0x11, 0x22, 0x33, 0xaa, 0xbb, 0xcc};
     //nRF_handler.write_payload(payload, 7);
 
-    while (true) {
-        asm("wfi");
-    }
-    return 0;
+    events::run();
 }
 
 extern "C" {
 [[maybe_unused]]
 void EXTI3_IRQHandler() {
-    GPIOC->ODR ^= 1 << 13;
-    nRF.write_reg(nRF24::STATUS, 0xff);
-    nRF.read_payload(rx_buffer, nRF.get_payload_length());
-    EXTI->PR = EXTI_PR_PIF3;
+    power::woken();
+    exti_lines::dispatch<3, 3>();
+}
+
+[[maybe_unused]]
+void EXTI15_10_IRQHandler() {
+    power::woken();
+    exti_lines::dispatch<10, 15>();
+}
+
+[[maybe_unused]]
+void DMA1_Channel2_IRQHandler() {
+    nrf_spi_handler.irq();
+}
+
+[[maybe_unused]]
+void DMA1_Channel5_IRQHandler() {
+    tea_i2c_handler.irq_dma_rx();
+}
+
+[[maybe_unused]]
+void I2C2_EV_IRQHandler() {
+    tea_i2c_handler.irq_event();
+}
+
+[[maybe_unused]]
+void I2C2_ER_IRQHandler() {
+    tea_i2c_handler.irq_error();
+}
+
+[[maybe_unused]]
+void DMA1_Channel6_IRQHandler() {
+    pwm::irq();
+}
+
+[[maybe_unused]]
+void DMA1_Channel7_IRQHandler() {
+    audio::irq();
+}
+
+[[maybe_unused]]
+void RTC_Alarm_IRQHandler() {
+    power::woken();
+    rtc::irq();
+}
+
+[[maybe_unused]]
+void TIM3_IRQHandler() {
+    timebase::irq_low();
+}
+
+[[maybe_unused]]
+void TIM4_IRQHandler() {
+    timebase::irq_high();
+}
+
+#ifdef IRQ_BENCH
+void USB_HP_CAN1_TX_IRQHandler() {
+    irq::bench::target_irq(irq::SAFETY);
+}
+
+void USB_LP_CAN1_RX0_IRQHandler() {
+    irq::bench::target_irq(irq::DMA);
+}
+
+void CAN1_RX1_IRQHandler() {
+    irq::bench::target_irq(irq::RADIO);
+}
+
+void CAN1_SCE_IRQHandler() {
+    irq::bench::target_irq(irq::TIMER);
+}
+
+void USART3_IRQHandler() {
+    irq::bench::load_irq();
 }
+#endif
 }
\ No newline at end of file
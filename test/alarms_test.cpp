@@ -0,0 +1,209 @@
+/**
+ * @file alarms_test.cpp
+ * Host test and benchmark of the alarm heap.\n
+ * Runs thousands of randomized edits, holiday changes and clock advances, and after each one checks the heap top
+ * against a brute force scan of next_after() over all slots, and the heap and position arrays against each other.
+ * Due alarms have to be saved before their callback runs, the flash erase would stall it.
+ * The storage pages are mapped at their flash address and the flash controller is a model that erases pages
+ * and clears its status bits on writing 1, so the table really goes through store::save and load.
+ * Prints the time per edit against the brute force scan the heap replaces.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sys/mman.h>
+#include "stm32f1xx.h"
+
+namespace model {
+    /**
+     * Status register, rc_w1
+     */
+    struct status_t {
+        uint32_t value;
+
+        operator uint32_t() const {
+            return value;
+        }
+
+        status_t &operator=(uint32_t v) {
+            value &= ~v;
+            return *this;
+        }
+    };
+
+    struct control_t {
+        uint32_t value;
+
+        operator uint32_t() const {
+            return value;
+        }
+
+        control_t &operator=(uint32_t v);
+    };
+
+    struct flash_t {
+        uint32_t ACR, KEYR, OPTKEYR;
+        status_t SR;
+        control_t CR;
+        uint32_t AR, RESERVED, OBR, WRPR;
+    };
+
+    flash_t flash;
+    uint32_t erases;
+
+    control_t &control_t::operator=(uint32_t v) {
+        value = v;
+        if ((v & (FLASH_CR_PER | FLASH_CR_STRT)) == (FLASH_CR_PER | FLASH_CR_STRT)) {
+            std::memset(reinterpret_cast<void *>(static_cast<uintptr_t>(flash.AR & ~1023U)), 0xff, 1024);
+            erases++;
+            flash.SR.value |= FLASH_SR_EOP;
+        }
+        return *this;
+    }
+}
+
+#undef FLASH
+#define FLASH (&model::flash)
+
+#include "alarms.h"
+
+namespace {
+    constexpr uint32_t EDITS = 20000;
+    constexpr uint32_t START = 820000000; // 2025-12-26, seconds since 2000-01-01
+
+    int failures;
+    std::mt19937 rng(4711);
+    uint32_t fired;
+
+    void check(bool ok, const char *what, uint32_t step, uint32_t value) {
+        if (!ok && failures++ < 20) {
+            std::printf("FAIL %s: step %u, %u\n", what, step, value);
+        }
+    }
+
+    uint32_t random(uint32_t limit) {
+        return static_cast<uint32_t>(rng() % limit);
+    }
+
+    void set_clock(uint32_t seconds) {
+        RTC->CNTH = seconds >> 16;
+        RTC->CNTL = seconds & 0xffff;
+    }
+
+    uint32_t brute_force_next(uint32_t now) {
+        uint32_t best = alarms::NEVER;
+        for (const alarms::alarm_t &alarm : alarms::table.alarms) {
+            uint32_t fire = alarms::next_after(alarm, now);
+            best = fire < best ? fire : best;
+        }
+        return best;
+    }
+
+    void check_heap(uint32_t step) {
+        for (uint8_t i = 0; i < alarms::heap_size; i++) {
+            check(alarms::position[alarms::heap[i]] == i, "position out of sync", step, i);
+            check(!i || !alarms::earlier(i, static_cast<uint8_t>((i - 1) / 2)), "heap order", step, i);
+        }
+        uint8_t queued = 0;
+        for (uint8_t position : alarms::position) {
+            queued += position != alarms::NOT_QUEUED;
+        }
+        check(queued == alarms::heap_size, "queued slots", step, queued);
+        uint32_t expected = brute_force_next(rtc::now());
+        check(alarms::next() == expected, "heap top is not the brute force minimum", step, alarms::next());
+    }
+
+    /**
+     * The one shot was disabled in flash before the callback ran
+     */
+    void on_fire(uint8_t slot, const alarms::alarm_t &alarm) {
+        alarms::table_t stored{};
+        bool loaded = alarms::store::load(stored);
+        check(loaded && stored.alarms[slot].flags == alarm.flags, "callback before the save", fired, slot);
+        fired++;
+    }
+
+    alarms::alarm_t random_alarm() {
+        uint8_t flags = alarms::ENABLED;
+        if (random(8) == 0) flags = 0;
+        if (random(4) == 0) flags |= alarms::ONE_SHOT;
+        if (random(4) == 0) flags |= alarms::HOLIDAYS_OFF;
+        return {static_cast<uint16_t>(random(24 * 60)), static_cast<uint8_t>(random(4) ? random(0x80) : 0), flags,
+                0, 0, 0};
+    }
+
+    void randomized() {
+        for (uint32_t step = 0; step < EDITS; step++) {
+            uint32_t op = random(100);
+            uint8_t slot = static_cast<uint8_t>(random(alarms::MAX_ALARMS));
+            if (op < 60) {
+                alarms::set(slot, random_alarm());
+            } else if (op < 70) {
+                alarms::skip_next(slot, random(2));
+            } else if (op < 75) {
+                uint16_t day = static_cast<uint16_t>(rtc::now() / 86400 + random(14));
+                random(2) ? alarms::add_holiday(day) : alarms::remove_holiday(day);
+            } else {
+                set_clock(rtc::now() + random(2 * 86400)); // Passes alarms, the RTC would fire on the first
+                if (alarms::next() <= rtc::now()) {
+                    alarms::on_alarm();
+                }
+            }
+            check_heap(step);
+        }
+    }
+
+    /**
+     * Time per edit of the heap against the scan over all slots it replaces
+     */
+    void benchmark() {
+        using clock = std::chrono::steady_clock;
+        constexpr uint32_t ROUNDS = 1000000;
+        uint32_t now = rtc::now(), sink = 0;
+        alarms::alarm_t edits[64];
+        for (alarms::alarm_t &alarm : edits) {
+            alarm = random_alarm();
+        }
+        auto start = clock::now();
+        for (uint32_t i = 0; i < ROUNDS; i++) {
+            uint8_t slot = static_cast<uint8_t>(i % alarms::MAX_ALARMS);
+            alarms::table.alarms[slot] = edits[i % 64];
+            alarms::update(slot, alarms::next_after(edits[i % 64], now));
+            sink += alarms::next();
+        }
+        double heap_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / ROUNDS;
+        start = clock::now();
+        for (uint32_t i = 0; i < ROUNDS; i++) {
+            alarms::table.alarms[i % alarms::MAX_ALARMS] = edits[i % 64];
+            sink += brute_force_next(now);
+        }
+        double scan_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / ROUNDS;
+        std::printf("benchmark: %.0fns per edit with the heap, %.0fns per brute force scan of %u alarms (%u)\n",
+                    heap_ns, scan_ns, alarms::MAX_ALARMS, sink & 1);
+        alarms::rebuild();
+        check_heap(EDITS);
+    }
+}
+
+int main() {
+    void *storage = mmap(reinterpret_cast<void *>(flash::STORAGE), flash::STORAGE_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (storage != reinterpret_cast<void *>(flash::STORAGE)) {
+        std::printf("alarms_test: cannot map the storage pages\n");
+        return 1;
+    }
+    RTC->CRL = RTC_CRL_RTOFF; // Configuration writes never wait
+    set_clock(START);
+    alarms::init(on_fire);
+    randomized();
+    std::printf("randomized: %u edits, %u alarms fired, %u in the heap at the end\n", EDITS, fired,
+                alarms::heap_size);
+    check(fired > 0, "no alarm fired", EDITS, 0);
+    benchmark();
+    std::printf(failures ? "alarms_test: %d failures\n" : "alarms_test: OK\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file brightness_test.cpp
+ * Host test of the perceptual brightness pipeline: the L* table against the ideal curve and the dithered
+ * output of every level in every PWM mode. The dither pattern of each level has to average to the duty and
+ * repeat fast enough not to flicker. Switching between the engines has to continue from the lit output.\n
+ * With a file argument the curve is written as CSV for plotting: level, ideal duty, table duty and the
+ * average of the dithered output, all in counts of the STANDARD mode.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#include <cmath>
+#include <cstdio>
+#include "cct.h"
+
+namespace {
+    constexpr double FLICKER_MIN_HZ = 60.0; // Lowest pattern component that is not seen as flicker
+
+    int failures;
+
+    void check(bool ok, const char *what, uint32_t level, double value) {
+        if (!ok && failures++ < 20) {
+            std::printf("FAIL %s: level %u, %f\n", what, level, value);
+        }
+    }
+
+    double ideal_duty(uint32_t level) {
+        return brightness::lstar_to_luminance(100.0 * level / 65535.0) * pwm::DUTY_MAX;
+    }
+
+    /**
+     * Runs the dither from a fresh state until it repeats
+     * @param frames Pattern length
+     * @return Average output over the pattern
+     */
+    double dither_pattern(uint32_t duty_q8, uint32_t &frames) {
+        brightness::dither_t dither{};
+        uint64_t sum = 0;
+        frames = 0;
+        do {
+            sum += dither.next(duty_q8);
+            frames++;
+        } while (dither.error != 0 && frames < 1024);
+        return static_cast<double>(sum) / frames;
+    }
+
+    void check_table(FILE *csv) {
+        uint32_t previous = 0;
+        double worst = 0;
+        pwm::mode = &pwm::modes[pwm::STANDARD];
+        for (uint32_t level = 0; level <= 0xffff; level++) {
+            uint32_t duty_q8 = brightness::to_duty_q8(static_cast<uint16_t>(level));
+            double ideal = ideal_duty(level);
+            double error = std::fabs(duty_q8 / 256.0 - ideal);
+            check(duty_q8 >= previous, "table not monotonic", level, duty_q8 / 256.0);
+            // Linear interpolation of the cubic, the error grows with the slope
+            check(error <= 0.5 + ideal * 0.002, "table off the ideal curve", level, error);
+            uint16_t back = brightness::to_level(duty_q8);
+            check(back <= level && level - back <= 1, "inverse off", level, back);
+            worst = error > worst ? error : worst;
+            previous = duty_q8;
+            if (csv) {
+                uint32_t frames;
+                double average = dither_pattern(duty_q8, frames);
+                std::fprintf(csv, "%u,%.4f,%.4f,%.4f\n", level, ideal, duty_q8 / 256.0, average);
+            }
+        }
+        std::printf("table: worst error %.3f counts\n", worst);
+    }
+
+    void check_dither(pwm::mode_t mode) {
+        pwm::mode = &pwm::modes[mode];
+        double rate = pwm::mode->frames_per_ms_q16 * 1000.0 / 65536.0;
+        double step = 1.0 / (1 << pwm::mode->dither_bits);
+        double lowest = rate;
+        for (uint32_t level = 0; level <= 0xffff; level++) {
+            uint32_t duty_q8 = brightness::to_duty_q8(static_cast<uint16_t>(level));
+            uint32_t frames;
+            double average = dither_pattern(duty_q8, frames);
+            double scaled = duty_q8 / 256.0 * pwm::mode->duty_scale_q16 / 65536.0;
+            check(std::fabs(average - scaled) <= step / 2 + 1.0 / 256, "dither average off", level, average - scaled);
+            if (frames > 1) {
+                double hz = rate / frames;
+                check(hz >= FLICKER_MIN_HZ, "dither flickers", level, hz);
+                lowest = hz < lowest ? hz : lowest;
+            }
+        }
+        std::printf("mode %u: %.0fHz PWM, %u dither bits, lowest pattern component %.1fHz\n",
+                    mode, rate, pwm::mode->dither_bits, lowest);
+    }
+
+    /**
+     * Starts a slow fade of the next engine and compares its first frame with what was lit
+     */
+    void check_switch(const char *what, void (*next)()) {
+        pwm::output_t lit = pwm::output;
+        next();
+        double warm = pwm::ring[0].warm - lit.warm_q8 / 256.0, cold = pwm::ring[0].cold - lit.cold_q8 / 256.0;
+        // Dither, level and mired rounding, and the top level a count below full scale
+        check(std::fabs(warm) <= 2 + lit.warm_q8 / 256e3, what, lit.warm_q8 >> 8, warm);
+        check(std::fabs(cold) <= 2 + lit.cold_q8 / 256e3, what, lit.cold_q8 >> 8, cold);
+    }
+
+    void check_handoff() {
+        pwm::mode = &pwm::modes[pwm::STANDARD];
+        cct::init();
+        brightness::set(30000, 10000);
+        check_switch("brightness to cct", [] { cct::fade(65535, 6500, 60000); });
+        check_switch("cct to ramp", [] { pwm::ramp::start(0, 0, 60000); });
+        check_switch("ramp to brightness", [] { brightness::fade(0, 65535, 60000); });
+        pwm::set(pwm::DUTY_MAX, 0);
+        check_switch("static to cct", [] { cct::fade(0, 2700, 60000); });
+        check(cct::kelvin() == 2700, "warm only is not 2700K", cct::kelvin(), 0);
+        pwm::set(0, 0);
+        check(!cct::current(), "dark is not level 0", cct::current(), 0);
+        std::printf("handoff: checked\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    FILE *csv = argc > 1 ? std::fopen(argv[1], "w") : nullptr;
+    check_table(csv);
+    if (csv) {
+        std::fclose(csv);
+    }
+    for (uint8_t mode = 0; mode < pwm::MODE_COUNT; mode++) {
+        check_dither(static_cast<pwm::mode_t>(mode));
+    }
+    check_handoff();
+    std::printf(failures ? "brightness_test: %d failures\n" : "brightness_test: OK\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file stm32f1xx.h
+ * Host stand-in for the device header, found before lib/ by the host tests.\n
+ * The register layouts and bit definitions are the real ones from lib/, only the Cortex-M core is replaced:
+ * the intrinsics are plain C++, PRIMASK and BASEPRI are variables, NVIC, SCB and DWT live in host memory and
+ * the cycle counter advances by CYCLES_PER_READ on every read, so busy waits end.
+ * PERIPH_BASE points into host memory, a test sets registers there before running a driver,
+ * e.g. RTC->CRL = RTC_CRL_RTOFF. Tests that need register side effects replace the peripheral type with a model.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#ifndef ALARM_CLOCK_LAMP_HOST_STM32F1XX_H
+#define ALARM_CLOCK_LAMP_HOST_STM32F1XX_H
+
+#include <cstdint>
+
+#define __CORE_CM3_H_GENERIC // Skips lib/core_cm3.h, the core is modelled below
+#define __CORE_CM3_H_DEPENDANT
+#define __I volatile const
+#define __O volatile
+#define __IO volatile
+#define __IM volatile const
+#define __OM volatile
+#define __IOM volatile
+
+#include "../../lib/stm32f1xx.h"
+
+namespace host {
+    constexpr uint32_t CYCLES_PER_READ = 72; // 1us per cycle counter read at 72MHz
+
+    inline uint32_t peripherals[0x24000 / 4]; // APB1, APB2 and AHB up to CRC
+    inline uint32_t primask;
+    inline uint32_t basepri;
+    inline uint32_t nvic_enabled[3];
+    inline uint32_t nvic_pending[3];
+    inline void (*wfi_hook)();
+
+    struct cyccnt_t {
+        uint32_t value;
+
+        operator uint32_t() {
+            value += CYCLES_PER_READ;
+            return value;
+        }
+
+        cyccnt_t &operator=(uint32_t v) {
+            value = v;
+            return *this;
+        }
+    };
+
+    struct scb_t {
+        uint32_t ICSR; // A test sets VECTACTIVE while it plays an interrupt
+        uint32_t SCR;
+        uint32_t AIRCR;
+    };
+
+    struct dwt_t {
+        uint32_t CTRL;
+        cyccnt_t CYCCNT;
+    };
+
+    struct core_debug_t {
+        uint32_t DEMCR;
+    };
+
+    inline scb_t scb;
+    inline dwt_t dwt;
+    inline core_debug_t core_debug;
+}
+
+#undef PERIPH_BASE
+#define PERIPH_BASE (reinterpret_cast<uintptr_t>(host::peripherals))
+
+#define SCB (&host::scb)
+#define DWT (&host::dwt)
+#define CoreDebug (&host::core_debug)
+#define SCB_ICSR_VECTACTIVE_Msk 0x1ffUL
+#define SCB_SCR_SLEEPDEEP_Msk (1UL << 2)
+#define DWT_CTRL_CYCCNTENA_Msk 1UL
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+inline void __disable_irq() { host::primask = 1; }
+inline void __enable_irq() { host::primask = 0; }
+inline uint32_t __get_PRIMASK() { return host::primask; }
+inline void __set_PRIMASK(uint32_t value) { host::primask = value; }
+inline uint32_t __get_BASEPRI() { return host::basepri; }
+inline void __set_BASEPRI(uint32_t value) { host::basepri = value; }
+
+inline void __set_BASEPRI_MAX(uint32_t value) {
+    if (value && (!host::basepri || value < host::basepri)) {
+        host::basepri = value;
+    }
+}
+
+inline void __WFI() {
+    if (host::wfi_hook) {
+        host::wfi_hook();
+    }
+}
+
+inline void __DSB() {}
+inline void __ISB() {}
+inline void __NOP() {}
+
+inline uint32_t __CLZ(uint32_t value) {
+    return value ? static_cast<uint32_t>(__builtin_clz(value)) : 32;
+}
+
+inline uint32_t __RBIT(uint32_t value) {
+    uint32_t result = 0;
+    for (uint8_t i = 0; i < 32; i++) {
+        result = result << 1 | (value >> i & 1);
+    }
+    return result;
+}
+
+inline uint32_t __ROR(uint32_t value, uint32_t shift) {
+    shift %= 32;
+    return shift ? value >> shift | value << (32 - shift) : value;
+}
+
+inline uint32_t __LDREXW(volatile uint32_t *address) { return *address; }
+
+inline uint32_t __STREXW(uint32_t value, volatile uint32_t *address) {
+    *address = value;
+    return 0;
+}
+
+inline void __CLREX() {}
+
+inline void NVIC_SetPriorityGrouping(uint32_t) {}
+inline void NVIC_SetPriority(IRQn_Type, uint32_t) {}
+inline void NVIC_EnableIRQ(IRQn_Type irqn) { host::nvic_enabled[irqn / 32] |= 1UL << (irqn % 32); }
+inline void NVIC_DisableIRQ(IRQn_Type irqn) { host::nvic_enabled[irqn / 32] &= ~(1UL << (irqn % 32)); }
+inline void NVIC_SetPendingIRQ(IRQn_Type irqn) { host::nvic_pending[irqn / 32] |= 1UL << (irqn % 32); }
+inline void NVIC_ClearPendingIRQ(IRQn_Type irqn) { host::nvic_pending[irqn / 32] &= ~(1UL << (irqn % 32)); }
+
+#endif //ALARM_CLOCK_LAMP_HOST_STM32F1XX_H
@@ -0,0 +1,312 @@
+/**
+ * @file i2c_test.cpp
+ * Host test of the I2C2 driver against a model of the I2C registers.\n
+ * Each register is a proxy that applies the side effects the driver relies on (SR1 then SR2 clears ADDR,
+ * the DR write after SB clears it, a DR read clears RXNE) and logs ACK, ADDR, STOP and START with the PRIMASK
+ * and control register state. The test plays the bus events and DMA transfers as interrupts and checks the
+ * errata sequences: a single byte read clears ACK and ADDR and sets STOP with interrupts disabled, before the
+ * byte completes, DMA reads NACK their last byte through LAST, and every end cancels the timeout.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include "peripherals.h"
+#include "irq.h"
+#include "timers.h"
+
+namespace model {
+    enum op_t : uint8_t {
+        START_SET,
+        ADDRESS_WRITTEN,
+        ACK_CLEARED,
+        ADDR_CLEARED,
+        STOP_SET,
+        ITBUFEN_SET
+    };
+
+    const char *const op_names[] = {"START", "address", "ACK cleared", "ADDR cleared", "STOP", "ITBUFEN"};
+
+    struct access_t {
+        op_t op;
+        bool masked; // PRIMASK set
+        uint32_t cr1;
+        uint32_t cr2;
+    };
+
+    struct reg_t {
+        uint32_t value;
+
+        operator uint32_t();
+        reg_t &operator=(uint32_t v);
+
+        reg_t &operator|=(uint32_t v) {
+            return *this = static_cast<uint32_t>(*this) | v;
+        }
+
+        reg_t &operator&=(uint32_t v) {
+            return *this = static_cast<uint32_t>(*this) & v;
+        }
+    };
+
+    struct i2c_t {
+        reg_t CR1, CR2, OAR1, OAR2, DR, SR1, SR2, CCR, TRISE;
+    };
+
+    i2c_t bus; // Global, the driver puts &DR into a 32 bit DMA register
+    bool sr1_read; // Since the last event, ADDR and SB clear on the access after it
+    access_t log[32];
+    uint8_t log_size;
+
+    void record(op_t op) {
+        if (log_size < 32) {
+            log[log_size++] = {op, host::primask != 0, bus.CR1.value, bus.CR2.value};
+        }
+    }
+
+    reg_t::operator uint32_t() {
+        if (this == &bus.SR1) {
+            sr1_read = true;
+        } else if (this == &bus.SR2 && sr1_read && (bus.SR1.value & I2C_SR1_ADDR)) {
+            bus.SR1.value &= ~I2C_SR1_ADDR;
+            record(ADDR_CLEARED);
+        } else if (this == &bus.DR) {
+            bus.SR1.value &= ~I2C_SR1_RXNE;
+        }
+        return value;
+    }
+
+    reg_t &reg_t::operator=(uint32_t v) {
+        uint32_t old = value;
+        value = v;
+        if (this == &bus.SR1) {
+            value = old & v; // rc_w0
+        } else if (this == &bus.DR && sr1_read && (bus.SR1.value & I2C_SR1_SB)) {
+            bus.SR1.value &= ~I2C_SR1_SB;
+            record(ADDRESS_WRITTEN);
+        } else if (this == &bus.CR1) {
+            if ((old & I2C_CR1_ACK) && !(v & I2C_CR1_ACK)) record(ACK_CLEARED);
+            if (!(old & I2C_CR1_STOP) && (v & I2C_CR1_STOP)) record(STOP_SET);
+            if (!(old & I2C_CR1_START) && (v & I2C_CR1_START)) record(START_SET);
+        } else if (this == &bus.CR2 && !(old & I2C_CR2_ITBUFEN) && (v & I2C_CR2_ITBUFEN)) {
+            record(ITBUFEN_SET);
+        }
+        return *this;
+    }
+}
+
+#define I2C_TypeDef model::i2c_t
+#include "STMF1_I2C_Handler.h"
+#undef I2C_TypeDef
+
+namespace {
+    constexpr uint8_t ADDRESS = 0x60;
+
+    int failures;
+    STMF1_I2C_Handler handler;
+    uint8_t rx[8], tx[8], sent[8];
+    uint32_t completions;
+
+    void check(bool ok, const char *what) {
+        if (!ok && failures++ < 20) {
+            std::printf("FAIL %s\n", what);
+        }
+    }
+
+    void completed(uint32_t) {
+        completions++;
+    }
+
+    void dump_log() {
+        for (uint8_t i = 0; i < model::log_size; i++) {
+            const model::access_t &a = model::log[i];
+            std::printf("  %-12s PRIMASK %u ACK %u LAST %u\n", model::op_names[a.op], a.masked,
+                        (a.cr1 & I2C_CR1_ACK) != 0, (a.cr2 & I2C_CR2_LAST) != 0);
+        }
+    }
+
+    /**
+     * Expects the logged operations from the given index on, in order
+     */
+    bool logged(uint8_t from, std::initializer_list<model::op_t> ops) {
+        if (model::log_size - from != ops.size()) {
+            return false;
+        }
+        uint8_t i = from;
+        for (model::op_t op : ops) {
+            if (model::log[i++].op != op) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Plays an interrupt, as the NVIC would run it
+     */
+    template<typename F>
+    void interrupt(IRQn_Type irqn, F body) {
+        host::scb.ICSR = irqn + 16;
+        body();
+        host::scb.ICSR = 0;
+        check(!host::primask, "interrupts left disabled");
+    }
+
+    void event(uint32_t sr1) {
+        model::bus.SR1.value |= sr1;
+        model::sr1_read = false;
+        interrupt(I2C2_EV_IRQn, [] { handler.irq_event(); });
+    }
+
+    void bus_error(uint32_t sr1) {
+        model::bus.SR1.value |= sr1;
+        interrupt(I2C2_ER_IRQn, [] { handler.irq_error(); });
+    }
+
+    /**
+     * The RX DMA moves the bytes, the peripheral ACKs each and NACKs the last if LAST is set
+     * @return Whether the last byte was NACKed
+     */
+    bool dma_read(const uint8_t *data, uint8_t length) {
+        check(DMA1_Channel5->CCR & DMA_CCR_EN, "RX DMA not enabled");
+        check(DMA1_Channel5->CNDTR == length, "RX DMA length");
+        uint8_t *target = reinterpret_cast<uint8_t *>(static_cast<uintptr_t>(DMA1_Channel5->CMAR));
+        for (uint8_t i = 0; i + 1 < length; i++) {
+            check(model::bus.CR1.value & I2C_CR1_ACK, "byte before the last not ACKed");
+            target[i] = data[i];
+        }
+        bool nack = (model::bus.CR2.value & (I2C_CR2_DMAEN | I2C_CR2_LAST)) == (I2C_CR2_DMAEN | I2C_CR2_LAST);
+        target[length - 1] = data[length - 1];
+        DMA1_Channel5->CNDTR = 0;
+        DMA1->ISR |= DMA_ISR_TCIF5;
+        interrupt(DMA1_Channel5_IRQn, [] { handler.irq_dma_rx(); });
+        return nack;
+    }
+
+    void dma_write(uint8_t length) {
+        check(DMA1_Channel4->CCR & DMA_CCR_EN, "TX DMA not enabled");
+        check(DMA1_Channel4->CNDTR == length, "TX DMA length");
+        std::memcpy(sent, reinterpret_cast<uint8_t *>(static_cast<uintptr_t>(DMA1_Channel4->CMAR)), length);
+        DMA1_Channel4->CNDTR = 0;
+    }
+
+    void start_event(bool read) {
+        check(model::log_size && model::log[model::log_size - 1].op == model::START_SET, "no START");
+        check(!read || (model::log[model::log_size - 1].cr1 & I2C_CR1_ACK), "ACK not set before START");
+        event(I2C_SR1_SB);
+        check(model::bus.DR.value == static_cast<uint32_t>(ADDRESS << 1 | read), "address byte");
+    }
+
+    /**
+     * The transaction ended with the result, and the first is_busy() leaves the wheel empty
+     */
+    void check_end(I2C_Handler::result_t result, const char *what) {
+        check(!handler.is_busy(), what);
+        check(handler.result() == result, what);
+        check(timers::empty(), "timeout still running");
+        check(!(model::bus.CR2.value & (I2C_CR2_DMAEN | I2C_CR2_LAST | I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN)),
+              "interrupts or DMA left enabled");
+        check(!(DMA1_Channel4->CCR & DMA_CCR_EN) && !(DMA1_Channel5->CCR & DMA_CCR_EN), "DMA channel left enabled");
+        model::bus.CR1.value &= ~(I2C_CR1_STOP | I2C_CR1_START); // The peripheral releases them on the bus
+        model::bus.SR1.value = 0;
+        model::log_size = 0;
+    }
+
+    void single_byte_read() {
+        handler.read_transaction(ADDRESS, rx, 1, false);
+        check(!(model::bus.CR2.value & I2C_CR2_DMAEN), "single byte read uses DMA");
+        check(!timers::empty(), "no timeout");
+        start_event(true);
+        uint8_t from = model::log_size;
+        event(I2C_SR1_ADDR);
+        bool sequence = logged(from, {model::ACK_CLEARED, model::ADDR_CLEARED, model::STOP_SET, model::ITBUFEN_SET});
+        check(sequence, "single byte read: not ACK cleared, ADDR cleared, STOP, ITBUFEN");
+        for (uint8_t i = from; sequence && i < from + 3; i++) {
+            check(model::log[i].masked, "single byte read: ACK, ADDR or STOP with interrupts enabled");
+            check(model::log[i].op == model::ACK_CLEARED || !(model::log[i].cr1 & I2C_CR1_ACK),
+                  "single byte read: ADDR or STOP with ACK set");
+        }
+        check(sequence && !model::log[from + 3].masked, "single byte read: RXNE interrupt while masked");
+        if (!sequence) {
+            dump_log();
+        }
+        check(handler.is_busy(), "single byte read ended early");
+        model::bus.DR.value = 0x5a;
+        event(I2C_SR1_RXNE | I2C_SR1_BTF);
+        check(rx[0] == 0x5a, "single byte read: data");
+        check_end(I2C_Handler::OK, "single byte read: result");
+    }
+
+    void dma_read() {
+        const uint8_t data[5] = {1, 2, 3, 4, 5};
+        handler.read_transaction(ADDRESS, rx, 5, false);
+        check((model::bus.CR2.value & (I2C_CR2_DMAEN | I2C_CR2_LAST)) == (I2C_CR2_DMAEN | I2C_CR2_LAST),
+              "DMA read without DMAEN and LAST");
+        start_event(true);
+        uint8_t from = model::log_size;
+        event(I2C_SR1_ADDR);
+        check(logged(from, {model::ADDR_CLEARED}), "DMA read: ADDR handling touched ACK or STOP");
+        from = model::log_size;
+        check(dma_read(data, 5), "DMA read: last byte not NACKed");
+        check(logged(from, {model::STOP_SET}), "DMA read: no STOP after the last byte");
+        check(!std::memcmp(rx, data, 5), "DMA read: data");
+        check_end(I2C_Handler::OK, "DMA read: result");
+    }
+
+    void dma_write() {
+        for (uint8_t i = 0; i < 5; i++) tx[i] = static_cast<uint8_t>(0xa0 + i);
+        handler.write_transaction(ADDRESS, tx, 5, false);
+        start_event(false);
+        event(I2C_SR1_ADDR);
+        event(I2C_SR1_BTF | I2C_SR1_TXE); // A slow DMA, bytes are still left
+        check(handler.is_busy(), "write ended on BTF before the DMA was done");
+        uint8_t from = model::log_size;
+        dma_write(5);
+        event(I2C_SR1_BTF | I2C_SR1_TXE);
+        check(logged(from, {model::STOP_SET}), "write: no STOP on the final BTF");
+        check(!std::memcmp(sent, tx, 5), "write: data");
+        check_end(I2C_Handler::OK, "write: result");
+    }
+
+    void address_nack() {
+        handler.write_transaction(ADDRESS, tx, 2, false);
+        start_event(false);
+        uint8_t from = model::log_size;
+        bus_error(I2C_SR1_AF);
+        check(logged(from, {model::STOP_SET}), "NACK: no STOP");
+        check(!(model::bus.SR1.value & I2C_SR1_AF), "NACK: AF not cleared");
+        check_end(I2C_Handler::NACK, "NACK: result");
+    }
+
+    void timeout() {
+        handler.read_transaction(ADDRESS, rx, 3, false);
+        timebase::skew += (STMF1_I2C_Handler::TIMEOUT_MS + 2) * 1000; // The slave never answers
+        timers::process();
+        check(handler.stats().timeouts == 1, "timeout: not counted");
+        check_end(I2C_Handler::TIMEOUT, "timeout: result");
+        handler.write_transaction(ADDRESS, tx, 2, true); // Blocking, ends on the cycle counter
+        check_end(I2C_Handler::TIMEOUT, "blocking timeout: result");
+    }
+}
+
+int main() {
+    TIM3->CNT = 1; // The timebase rereads while LOW is 0
+    GPIOB->IDR = 1 << 11; // SDA released, the recovery clocks no pulses
+    timers::init();
+    handler.set_periphs(&model::bus, DMA1_Channel4, DMA1_Channel5, GPIOB, 10, 11);
+    handler.config_periph();
+    handler.set_callback(completed, 0);
+    model::bus.CR1.value = I2C_CR1_PE;
+    single_byte_read();
+    dma_read();
+    dma_write();
+    address_nack();
+    timeout();
+    check(completions == 6, "callback count");
+    std::printf("i2c: %u transfers, %u nacks, %u timeouts, %u recoveries\n", handler.stats().transfers,
+                handler.stats().nacks, handler.stats().timeouts, handler.stats().recoveries);
+    std::printf(failures ? "i2c_test: %d failures\n" : "i2c_test: OK\n", failures);
+    return failures != 0;
+}
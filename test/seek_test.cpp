@@ -0,0 +1,268 @@
+/**
+ * @file seek_test.cpp
+ * Host simulation of the tuner seek against a TEA5767 model on a simulated clock.\n
+ * The model answers the I2C transactions of tuner.h from a level profile in the format of a band scan,
+ * tuner::scan_levels: one byte per 100kHz from 87.5MHz, level in the low nibble, bit 7 IF count valid,
+ * bit 6 stereo. Transactions take their bus time at 400kHz, the timer wheel runs on the timebase compare,
+ * both on a clock that advances in SIM_STEP_US. The built in profiles are generated from station lists with
+ * adjacent channel leakage and high side images, recorded scans are replayed from files given as arguments,
+ * one line per 100kHz step with the byte in decimal or hex.\n
+ * For every profile and budget the seek has to stay within the budget and find a station with a valid IF count
+ * at most one level below the strongest, the time it takes is printed.
+ * @author Florian Guggi
+ * @date 19.10.2026
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include "tuner.h"
+
+namespace {
+    constexpr uint32_t SIM_STEP_US = 50;
+    constexpr uint32_t I2C_BIT_NS = 2500; // 400kHz
+    constexpr uint32_t UNLIMITED_MS = 5000;
+
+    using profile_t = uint8_t[tuner::SCAN_STEPS];
+
+    int failures;
+
+    void check(bool ok, const char *what, const char *profile, uint32_t value) {
+        if (!ok && failures++ < 20) {
+            std::printf("FAIL %s: %s, %u\n", what, profile, value);
+        }
+    }
+
+    uint32_t sim_now_us() {
+        return static_cast<uint32_t>(timebase::skew);
+    }
+
+    /**
+     * TEA5767 behind the I2C handler interface, answers from a profile
+     */
+    class tea_model_t : public I2C_Handler {
+        callback_t callback{};
+        uint32_t callback_arg{};
+        bool busy{};
+        uint32_t done_us{};
+        uint8_t *rx{};
+        uint32_t tuned_khz{};
+        bool high_side{};
+
+        void begin(uint8_t length) {
+            busy = true;
+            done_us = sim_now_us() + ((length + 1) * 9 * I2C_BIT_NS + 999) / 1000;
+        }
+
+        /**
+         * Profile entry nearest to a frequency
+         */
+        uint8_t entry(uint32_t khz) const {
+            if (khz < TEA5767::BAND_LOW_KHZ || khz > TEA5767::BAND_HIGH_KHZ) {
+                return 1;
+            }
+            return (*profile)[(khz - TEA5767::BAND_LOW_KHZ + tuner::STEP_KHZ / 2) / tuner::STEP_KHZ];
+        }
+
+    public:
+        const profile_t *profile{};
+        uint32_t writes{}, reads{};
+
+        void config_periph() override {}
+
+        void write_transaction(uint8_t, const uint8_t *data, uint8_t length, bool) override {
+            uint32_t pll = static_cast<uint32_t>(data[0] & 0x3f) << 8 | data[1];
+            uint32_t lo_khz = (pll * 8192 + 500) / 1000;
+            high_side = data[2] & TEA5767::HLSI;
+            tuned_khz = high_side ? lo_khz - TEA5767::IF_KHZ : lo_khz + TEA5767::IF_KHZ;
+            writes++;
+            begin(length);
+        }
+
+        void read_transaction(uint8_t, uint8_t *rxbuffer, uint8_t length, bool) override {
+            rx = rxbuffer;
+            reads++;
+            begin(length);
+        }
+
+        bool is_busy() override {
+            return busy;
+        }
+
+        result_t result() override {
+            return OK;
+        }
+
+        void set_callback(callback_t callback_, uint32_t arg) override {
+            callback = callback_;
+            callback_arg = arg;
+        }
+
+        /**
+         * Ends a transaction whose bus time is over, from the simulation loop as the DMA interrupt would
+         */
+        void poll() {
+            if (!busy || static_cast<int32_t>(sim_now_us() - done_us) < 0) {
+                return;
+            }
+            if (rx) {
+                uint8_t e = entry(tuned_khz);
+                uint32_t pll = (4000 * (high_side ? tuned_khz + TEA5767::IF_KHZ : tuned_khz - TEA5767::IF_KHZ) + (1 << 14)) >> 15;
+                rx[0] = static_cast<uint8_t>(0x80 | (pll >> 8 & 0x3f));
+                rx[1] = static_cast<uint8_t>(pll);
+                rx[2] = static_cast<uint8_t>((e & 0x40 ? 0x80 : 0) | (e & 0x80 ? 0x37 : 0x20));
+                rx[3] = static_cast<uint8_t>((e & 0x0f) << 4);
+                rx[4] = 0;
+                rx = nullptr;
+            }
+            busy = false;
+            if (callback) {
+                callback(callback_arg);
+            }
+        }
+    };
+
+    tea_model_t model;
+
+    /**
+     * Fires the timebase compares that came due, as TIM3/TIM4 would
+     */
+    void run_compares() {
+        uint32_t now = timebase::now_us32();
+        if ((timebase::LOW->DIER & TIM_DIER_CC1IE || timebase::HIGH->DIER & TIM_DIER_CC1IE)
+            && static_cast<int32_t>(now - timebase::compare_target) >= 0) {
+            timebase::cancel_compare();
+            timebase::compare_callback();
+        }
+        if (timebase::short_compare_pending() && static_cast<int32_t>(now - timebase::short_target) >= 0) {
+            timebase::cancel_short_compare();
+            timebase::short_callback();
+        }
+    }
+
+    /**
+     * Runs the event loop on the simulated clock until the tuner is idle
+     * @return Simulated time in ms
+     */
+    uint32_t run_until_idle() {
+        uint32_t start = sim_now_us();
+        do {
+            events::dispatch();
+            timebase::skew += SIM_STEP_US;
+            model.poll();
+            run_compares();
+        } while ((tuner::busy() || events::pending()) && sim_now_us() - start < UNLIMITED_MS * 2000);
+        return (sim_now_us() - start) / 1000;
+    }
+
+    /**
+     * Station list to a scan record: each station leaks into its neighbors with a falling level and an IF count
+     * out of range, and shows as a weaker image 450kHz below it, where high side injection puts its image
+     */
+    struct station_t {
+        uint32_t khz;
+        uint8_t level;
+    };
+
+    void generate(profile_t &profile, std::initializer_list<station_t> stations, uint8_t noise) {
+        for (uint16_t i = 0; i < tuner::SCAN_STEPS; i++) {
+            uint32_t khz = TEA5767::BAND_LOW_KHZ + i * tuner::STEP_KHZ;
+            uint8_t best = static_cast<uint8_t>(noise ? (i * 7 + i / 3) % (noise + 1) : 0);
+            for (const station_t &s : stations) {
+                uint32_t off = khz > s.khz ? khz - s.khz : s.khz - khz;
+                uint32_t image = s.khz > 450 + khz ? s.khz - 450 - khz : khz + 450 - s.khz;
+                uint8_t entry = 0;
+                if (off < 50) {
+                    entry = static_cast<uint8_t>(s.level | 0x80 | (s.level >= 9 ? 0x40 : 0));
+                } else if (off <= 300) {
+                    entry = static_cast<uint8_t>(s.level > off / 25 ? s.level - off / 25 : 0);
+                } else if (image <= 100 && s.level > 5) {
+                    entry = static_cast<uint8_t>(s.level - 5); // Image rejection of ~30dB
+                }
+                if ((entry & 0x0f) > (best & 0x0f)) {
+                    best = entry;
+                }
+            }
+            profile[i] = best;
+        }
+    }
+
+    bool load(profile_t &profile, const char *path) {
+        FILE *file = std::fopen(path, "r");
+        if (!file) {
+            return false;
+        }
+        char line[32];
+        uint16_t i = 0;
+        while (i < tuner::SCAN_STEPS && std::fgets(line, sizeof(line), file)) {
+            profile[i++] = static_cast<uint8_t>(std::strtoul(line, nullptr, 0));
+        }
+        std::fclose(file);
+        return i == tuner::SCAN_STEPS;
+    }
+
+    /**
+     * Strongest entry with a valid IF count, 0 if there is none
+     */
+    uint8_t strongest(const profile_t &profile) {
+        uint8_t best = 0;
+        for (uint8_t e : profile) {
+            if (e & 0x80 && (e & 0x0f) > best) {
+                best = e & 0x0f;
+            }
+        }
+        return best;
+    }
+
+    void seek(const char *name, const profile_t &profile, uint32_t budget_ms) {
+        model.profile = &profile;
+        check(tuner::seek(budget_ms), "seek not started", name, budget_ms);
+        uint32_t total_ms = run_until_idle();
+        const tuner::seek_stats_t &stats = tuner::seek_stats;
+        uint8_t found = stats.found_khz ? profile[(stats.found_khz - TEA5767::BAND_LOW_KHZ) / tuner::STEP_KHZ] : 0;
+        std::printf("%-10s budget %4ums: seek %3ums, %2u probes, total with tune %3ums, found %6ukHz level %u of %u\n",
+                    name, budget_ms, stats.elapsed_ms, stats.probes, total_ms, stats.found_khz, found & 0x0f,
+                    strongest(profile));
+        check(!tuner::busy(), "still busy", name, total_ms);
+        check(!stats.found_khz || found & 0x80, "stopped on an IF count out of range", name, stats.found_khz);
+        check(stats.elapsed_ms <= budget_ms, "budget overrun", name, stats.elapsed_ms);
+        if (budget_ms == UNLIMITED_MS) {
+            check(stats.elapsed_ms <= 800, "slower than documented", name, stats.elapsed_ms);
+        }
+        check((found & 0x0f) + 1 >= strongest(profile), "missed the strongest station", name, budget_ms);
+    }
+
+    profile_t empty, rural, city, images;
+}
+
+int main(int argc, char **argv) {
+    TIM3->CNT = 1; // The timebase rereads while LOW is 0
+    timers::init();
+    async::init();
+    tuner::tea.set_i2c_handler(&model);
+    generate(empty, {}, 2);
+    generate(rural, {{89300, 9}, {94800, 12}, {101700, 7}}, 3);
+    generate(city, {{88600, 10}, {90100, 12}, {91400, 11}, {93700, 13}, {95200, 9}, {97800, 14}, {99400, 12},
+                    {101100, 10}, {102800, 13}, {104600, 11}, {106300, 12}}, 3);
+    generate(images, {{96000, 8}, {103500, 14}}, 2); // The image of the strong one, level 9 at 103.0/103.1MHz, beats 96MHz
+    const struct {
+        const char *name;
+        const profile_t &profile;
+    } profiles[] = {{"empty", empty}, {"rural", rural}, {"city", city}, {"images", images}};
+    for (const auto &p : profiles) {
+        seek(p.name, p.profile, UNLIMITED_MS);
+        seek(p.name, p.profile, 500);
+        seek(p.name, p.profile, 300);
+    }
+    for (int i = 1; i < argc; i++) {
+        static profile_t recorded;
+        if (!load(recorded, argv[i])) {
+            std::printf("seek_test: cannot read %u steps from %s\n", tuner::SCAN_STEPS, argv[i]);
+            return 1;
+        }
+        seek(argv[i], recorded, UNLIMITED_MS);
+    }
+    std::printf("i2c: %u writes, %u reads\n", model.writes, model.reads);
+    std::printf(failures ? "seek_test: %d failures\n" : "seek_test: OK\n", failures);
+    return failures != 0;
+}